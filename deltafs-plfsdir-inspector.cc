@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2017, Carnegie Mellon University.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * deltafs-plfsdir-inspector.cc
+ *
+ * report the on-disk layout of a plfsdir written by deltafs-plfsdir-runner.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <deltafs/deltafs_api.h>
+
+#include <mpi.h>
+
+/*
+ * helper/utility functions, included inline here so we are self-contained
+ * in one single source file...
+ */
+static char* argv0; /* argv[0], program name */
+
+/*
+ * vcomplain/complain about something and exit.
+ */
+static void vcomplain(const char* format, va_list ap) {
+  fprintf(stderr, "!!! ERROR !!! %s: ", argv0);
+  vfprintf(stderr, format, ap);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+static void complain(const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  vcomplain(format, ap);
+  va_end(ap);
+}
+
+/*
+ * print info messages.
+ */
+static void vinfo(const char* format, va_list ap) {
+  printf("-INFO- ");
+  vprintf(format, ap);
+  printf("\n");
+}
+
+static void info(const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  vinfo(format, ap);
+  va_end(ap);
+}
+
+/*
+ * now: get current time in micros
+ */
+static uint64_t now() {
+  struct timeval tv;
+  uint64_t rv;
+
+  gettimeofday(&tv, NULL);
+  rv = tv.tv_sec * 1000000LLU + tv.tv_usec;
+
+  return rv;
+}
+
+/*
+ * end of helper/utility functions.
+ */
+
+/*
+ * default values
+ */
+#define DEF_TIMEOUT 300 /* alarm timeout (secs) */
+#define DEF_NUM_EPOCHS 8
+#define DEF_KEY_SIZE 8
+#define DEF_VAL_SIZE 32
+#define DEF_FILTER_BITS 10
+
+/*
+ * gs: shared global data (e.g. from the command line)
+ */
+static struct gs {
+  int myrank;          /* my rank id */
+  int commsz;          /* mpi world size */
+  const char* dirname; /* plfsdir name */
+  int nwriters;        /* num of writer ranks that produced the plfsdir */
+  int nepochs;
+  int keysz;
+  int valsz;
+  int filterbits;
+  int logrotation;
+  const char* conf;  /* plfsdir conf used by the runner, NULL for none */
+  const char* extra; /* extra plfsdir conf, NULL for none */
+  int timeout;
+  int v;
+} g;
+
+/*
+ * alarm signal handler
+ */
+static void sigalarm(int foo) {
+  fprintf(stderr, "!!! SIGALRM detected !!!\n");
+  fprintf(stderr, "alarm clock\n");
+  exit(1);
+}
+
+/*
+ * usage
+ */
+static void usage(const char* msg) {
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "usage: %s [options] plfsdir\n", argv0);
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "\t-t sec    timeout (alarm), in seconds\n");
+  fprintf(stderr, "\t-w num    num of writer ranks that produced plfsdir\n");
+  fprintf(stderr, "\t-e num    num of epochs\n");
+  fprintf(stderr, "\t-k bytes  key size\n");
+  fprintf(stderr, "\t-d bytes  value size\n");
+  fprintf(stderr, "\t-f num    filter bits per key\n");
+  fprintf(stderr, "\t-r        the plfsdir was written with log rotation\n");
+  fprintf(stderr, "\t-C conf   plfsdir conf printed by the runner, replaces "
+                  "-k -d -f -r\n");
+  fprintf(stderr, "\t-K conf   extra plfsdir conf (k1=v1&k2=v2...)\n");
+  fprintf(stderr, "\t-v        be verbose\n");
+  exit(1);
+}
+
+/*
+ * print the options
+ */
+static void printopts() {
+  printf("\n%s\n==options:\n", argv0);
+  printf("\ttimeout: %d\n", g.timeout);
+  printf("\tnum writers: %d\n", g.nwriters);
+  printf("\tnum epochs: %d\n", g.nepochs);
+  printf("\tkey size: %d\n", g.keysz);
+  printf("\tvalue size: %d\n", g.valsz);
+  printf("\tfilter bits per key: %d\n", g.filterbits);
+  printf("\tlog rotation: %d\n", g.logrotation);
+  printf("\trunner conf: %s\n", g.conf ? g.conf : "(none)");
+  printf("\textra conf: %s\n", g.extra ? g.extra : "(none)");
+  printf("\tplfsdir: %s\n", g.dirname);
+  printf("\tnum ranks: %d\n", g.commsz);
+  printf("\n");
+}
+
+/*
+ * per-partition layout stats
+ */
+enum {
+  P_FILES,  /* num of files */
+  P_DATA,   /* data log bytes */
+  P_INDEX,  /* index log bytes (index blocks and filters) */
+  P_KEYS,   /* num of keys found by scans */
+  P_USER,   /* key and value bytes found by scans */
+  P_TABLES, /* num of tables, -1 if not exposed by the plfsdir */
+  P_FILTER, /* filter bytes, -1 if not exposed by the plfsdir */
+  P_NUM
+};
+
+/*
+ * property names for P_TABLES and P_FILTER
+ */
+static const char* props[2] = {"num_sstables", "sstable_filter_bytes"};
+
+/*
+ * ssaver: scan callback counting keys and bytes
+ */
+static int ssaver(void* arg, const char* key, size_t keylen, const char* value,
+                  size_t sz) {
+  double* v = static_cast<double*>(arg);
+  v[0] += 1;
+  v[1] += keylen + sz;
+  return 0;
+}
+
+/*
+ * lsfiles: add up the sizes of the data and index logs of a partition
+ */
+static void lsfiles(int w, double* p) {
+  std::string path;
+  struct dirent* ent;
+  struct stat st;
+  char prefix[20];
+  DIR* d;
+
+  snprintf(prefix, sizeof(prefix), "L-%08x", w);
+  d = opendir(g.dirname);
+  if (!d) complain("cannot open %s: %s", g.dirname, strerror(errno));
+  while ((ent = readdir(d)) != NULL) {
+    if (strncmp(ent->d_name, prefix, strlen(prefix)) != 0) continue;
+    path = std::string(g.dirname) + "/" + ent->d_name;
+    if (stat(path.c_str(), &st) != 0) continue;
+    p[P_FILES] += 1;
+    if (strstr(ent->d_name, ".idx")) {
+      p[P_INDEX] += st.st_size;
+    } else {
+      p[P_DATA] += st.st_size;
+    }
+  }
+  closedir(d);
+}
+
+/*
+ * mkconf: get the plfsdir conf of a partition (writer rank). this is
+ * either the conf given with -C, with its rank replaced, or the one the
+ * runner would build from the same flags.
+ */
+static std::string mkconf(int w) {
+  std::string rv;
+  std::string kv;
+  const char* p;
+  const char* q;
+  char tmp[200];
+
+  snprintf(tmp, sizeof(tmp), "rank=%d", w);
+  rv = tmp;
+  if (g.conf) {
+    for (p = g.conf; *p; p = *q ? q + 1 : q) {
+      q = strchr(p, '&');
+      if (!q) q = p + strlen(p);
+      kv.assign(p, q - p);
+      if (!kv.empty() && kv.compare(0, 5, "rank=") != 0) rv += "&" + kv;
+    }
+  } else {
+    snprintf(tmp, sizeof(tmp),
+             "&tail_padding=1&block_padding=1&key_size=%d&value_size=%d"
+             "&bf_bits_per_key=%d&epoch_log_rotation=%d&lg_parts=0",
+             g.keysz, g.valsz, g.filterbits, g.logrotation);
+    rv += tmp;
+  }
+  if (g.extra) rv += std::string("&") + g.extra;
+
+  return rv;
+}
+
+/*
+ * per-epoch layout stats. keys and user bytes are counted by scans. the
+ * plfsdir only exposes table, index and filter sizes per partition, so
+ * these are split over epochs by each epoch's share of user bytes.
+ */
+enum {
+  E_KEYS,   /* num of keys found by scans */
+  E_USER,   /* key and value bytes found by scans */
+  E_DATA,   /* est. data log bytes */
+  E_INDEX,  /* est. index block bytes */
+  E_FILTER, /* est. filter bytes, -1 if not exposed by the plfsdir */
+  E_NUM
+};
+
+/*
+ * inspect: inspect a partition (writer rank). p gets the partition's
+ * stats and ep the stats of each epoch.
+ */
+static void inspect(int w, double* p, double* ep) {
+  deltafs_plfsdir_t* h;
+  double share;
+  long long v;
+  int r;
+
+  lsfiles(w, p);
+  h = deltafs_plfsdir_create_handle(mkconf(w).c_str(), O_RDONLY);
+  if (!h) complain("fail to create plfsdir handle");
+  r = deltafs_plfsdir_open(h, g.dirname);
+  if (r) complain("error opening dir partition %d: %s", w, strerror(errno));
+  for (int e = 0; e < g.nepochs; e++) {
+    if (deltafs_plfsdir_scan(h, e, ssaver, &ep[E_NUM * e]) < 0)
+      complain("error scanning partition %d epoch %d", w, e);
+  }
+  for (int i = 0; i < 2; i++) {
+    v = deltafs_plfsdir_get_integer_property(h, props[i]);
+    p[P_TABLES + i] = v < 0 ? -1 : double(v);
+  }
+  deltafs_plfsdir_free_handle(h);
+  for (int e = 0; e < g.nepochs; e++) {
+    p[P_KEYS] += ep[E_NUM * e + E_KEYS];
+    p[P_USER] += ep[E_NUM * e + E_USER];
+  }
+  for (int e = 0; e < g.nepochs; e++) {
+    double* x = &ep[E_NUM * e];
+    share = p[P_USER] ? x[E_USER] / p[P_USER] : 0;
+    x[E_DATA] = share * p[P_DATA];
+    if (p[P_FILTER] < 0) {
+      x[E_INDEX] = share * p[P_INDEX];
+      x[E_FILTER] = -1;
+    } else {
+      x[E_INDEX] = share * (p[P_INDEX] - p[P_FILTER]);
+      x[E_FILTER] = share * p[P_FILTER];
+    }
+  }
+}
+
+/*
+ * prow: print the layout of a partition or of the whole plfsdir
+ */
+static void prow(const char* name, const double* p) {
+  char tables[20];
+  char filter[40];
+
+  snprintf(tables, sizeof(tables), p[P_TABLES] < 0 ? "n/a" : "%.0f",
+           p[P_TABLES]);
+  snprintf(filter, sizeof(filter), p[P_FILTER] < 0 ? "n/a" : "%.0f bytes",
+           p[P_FILTER]);
+  /* overhead covers padding, block trailers, encoding and checksums */
+  printf("\t%s: %.0f files, %.0f keys, %s tables, data %.0f bytes, "
+         "index+filter %.0f bytes (filter %s), overhead %.0f bytes, "
+         "user bytes %.1f%% of data, %.1f bytes/key\n",
+         name, p[P_FILES], p[P_KEYS], tables, p[P_DATA], p[P_INDEX], filter,
+         p[P_DATA] > p[P_USER] ? p[P_DATA] - p[P_USER] : 0.0,
+         p[P_DATA] ? p[P_USER] * 100 / p[P_DATA] : 0.0,
+         p[P_KEYS] ? (p[P_DATA] + p[P_INDEX]) / p[P_KEYS] : 0.0);
+}
+
+/*
+ * main program
+ */
+int main(int argc, char* argv[]) {
+  std::vector<double> parts;
+  std::vector<double> epochs;
+  std::vector<double> tmp;
+  double total[P_NUM];
+  char filter[40];
+  char name[20];
+  uint64_t t;
+  int r, ch;
+  r = MPI_Init(&argc, &argv);
+  if (r != MPI_SUCCESS) complain("fail to init mpi");
+  argv0 = argv[0];
+  /* we want lines, even if we are writing to a pipe */
+  setlinebuf(stdout);
+
+  memset(&g, 0, sizeof(g));
+  r = MPI_Comm_rank(MPI_COMM_WORLD, &g.myrank);
+  if (r != MPI_SUCCESS) complain("cannot get proc mpi rank");
+  r = MPI_Comm_size(MPI_COMM_WORLD, &g.commsz);
+  if (r != MPI_SUCCESS) complain("cannot get mpi world size");
+
+  g.nepochs = DEF_NUM_EPOCHS;
+  g.keysz = DEF_KEY_SIZE;
+  g.valsz = DEF_VAL_SIZE;
+  g.filterbits = DEF_FILTER_BITS;
+  g.timeout = DEF_TIMEOUT;
+
+  while ((ch = getopt(argc, argv, "t:w:e:k:d:f:C:K:rv")) != -1) {
+    switch (ch) {
+      case 't':
+        g.timeout = atoi(optarg);
+        if (g.timeout < 0) usage("bad timeout");
+        break;
+      case 'w':
+        g.nwriters = atoi(optarg);
+        if (g.nwriters <= 0) usage("bad writer nums");
+        break;
+      case 'e':
+        g.nepochs = atoi(optarg);
+        if (g.nepochs < 0) usage("bad epoch nums");
+        break;
+      case 'k':
+        g.keysz = atoi(optarg);
+        if (g.keysz <= 0) usage("bad key size");
+        break;
+      case 'd':
+        g.valsz = atoi(optarg);
+        if (g.valsz < 0) usage("bad value size");
+        break;
+      case 'f':
+        g.filterbits = atoi(optarg);
+        if (g.filterbits < 0) usage("bad filter bits");
+        break;
+      case 'r':
+        g.logrotation = 1;
+        break;
+      case 'C':
+        g.conf = optarg;
+        break;
+      case 'K':
+        g.extra = optarg;
+        break;
+      case 'v':
+        g.v = 1;
+        break;
+      default:
+        usage(NULL);
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  if (argc == 0) /* plfsdir must be provided on command line */
+    usage("bad args");
+  g.dirname = argv[0];
+  if (!g.nwriters) g.nwriters = g.commsz;
+  if (!g.myrank) printopts();
+
+  signal(SIGALRM, sigalarm);
+  alarm(g.timeout);
+
+  if (g.v && !g.myrank) info("inspection begins ...");
+  parts.assign(size_t(g.nwriters) * P_NUM, 0);
+  epochs.assign(size_t(g.nepochs) * E_NUM, 0);
+  MPI_Barrier(MPI_COMM_WORLD);
+  t = now();
+  /* partitions are spread over ranks so that they are walked in parallel */
+  for (int w = g.myrank; w < g.nwriters; w += g.commsz) {
+    tmp.assign(epochs.size(), 0);
+    inspect(w, &parts[size_t(w) * P_NUM], tmp.data());
+    for (size_t i = 0; i < tmp.size(); i++) epochs[i] += tmp[i];
+  }
+  t = now() - t;
+  r = MPI_Reduce(g.myrank ? parts.data() : MPI_IN_PLACE, parts.data(),
+                 int(parts.size()), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(g.myrank ? epochs.data() : MPI_IN_PLACE, epochs.data(),
+                 int(epochs.size()), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(g.myrank ? &t : MPI_IN_PLACE, &t, 1, MPI_UINT64_T, MPI_MAX, 0,
+                 MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+
+  if (!g.myrank) {
+    printf("\n==per rank layout:\n");
+    memset(total, 0, sizeof(total));
+    for (int w = 0; w < g.nwriters; w++) {
+      double* p = &parts[size_t(w) * P_NUM];
+      snprintf(name, sizeof(name), "rank %d", w);
+      prow(name, p);
+      for (int i = 0; i < P_NUM; i++) {
+        if (total[i] >= 0) total[i] = p[i] < 0 ? -1 : total[i] + p[i];
+      }
+    }
+    printf("\n==per epoch layout (data, index and filter est. by user "
+           "bytes):\n");
+    for (int e = 0; e < g.nepochs; e++) {
+      double* x = &epochs[size_t(E_NUM) * e];
+      double bytes = x[E_DATA] + x[E_INDEX] + std::max(x[E_FILTER], 0.0);
+      snprintf(filter, sizeof(filter), x[E_FILTER] < 0 ? "n/a" : "%.0f bytes",
+               x[E_FILTER]);
+      printf("\tepoch %d: %.0f keys, %.0f user bytes, data %.0f bytes, "
+             "index %.0f bytes, filter %s, %.1f bytes/key\n",
+             e, x[E_KEYS], x[E_USER], x[E_DATA], x[E_INDEX], filter,
+             x[E_KEYS] ? bytes / x[E_KEYS] : 0.0);
+    }
+    printf("\n==total layout:\n");
+    prow("all ranks", total);
+    printf("\tinspected in %.3f s\n", double(t) / 1000000);
+  }
+
+  MPI_Finalize();
+
+  if (g.v && !g.myrank) info("all done!");
+  if (g.v && !g.myrank) info("bye");
+
+  exit(0);
+}
@@ -35,17 +35,35 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <numeric>
 #include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include <deltafs/deltafs_api.h>
 
@@ -55,11 +73,17 @@
  * helper/utility functions, included inline here so we are self-contained
  * in one single source file...
  */
-static char* argv0;            /* argv[0], program name */
-static deltafs_plfsdir_t* dir; /* plfsdir handle */
-static deltafs_env_t* env;     /* plfsdir storage abs */
-static deltafs_tp_t* bgp;      /* plfsdir worker thread pool */
-static char cf[500];           /* plfsdir conf str */
+static char* argv0;              /* argv[0], program name */
+static deltafs_plfsdir_t** dirs; /* plfsdir handles (one per output dir) */
+static deltafs_plfsdir_t** rd;   /* plfsdir read handles (one per partition) */
+static int cold;                 /* reads are expected to go to storage */
+static int notify;               /* announce flushed epochs to readers */
+static int quiet;                /* skip write reports */
+static uint64_t wtime;           /* open to finish time of the last write */
+static MPI_Comm comm;            /* ranks writing the plfsdir */
+static deltafs_env_t* env;       /* plfsdir storage abs */
+static deltafs_tp_t* bgp;        /* plfsdir worker thread pool */
+static std::string cf;           /* plfsdir conf str */
 static struct bbos_conf {
   char remote[50]; /* bbos remote uri */
   char lo[50];     /* bbos local uri */
@@ -111,6 +135,44 @@ static uint64_t now() {
   return rv;
 }
 
+/*
+ * ioread: get the num of bytes read by the calling process so far, both
+ * through read syscalls (rchar) and from storage (read_bytes).
+ */
+static void ioread(uint64_t* rchar, uint64_t* rbytes) {
+  unsigned long long v;
+  char line[100];
+  FILE* f;
+
+  *rchar = *rbytes = 0;
+  f = fopen("/proc/self/io", "r");
+  if (!f) return;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "rchar: %llu", &v) == 1) *rchar = v;
+    if (sscanf(line, "read_bytes: %llu", &v) == 1) *rbytes = v;
+  }
+  fclose(f);
+}
+
+/*
+ * iowrite: get the num of bytes written through write syscalls (wchar)
+ * by the calling process so far, and the num of write syscalls (syscw).
+ */
+static void iowrite(uint64_t* wchar, uint64_t* syscw) {
+  unsigned long long v;
+  char line[100];
+  FILE* f;
+
+  *wchar = *syscw = 0;
+  f = fopen("/proc/self/io", "r");
+  if (!f) return;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "wchar: %llu", &v) == 1) *wchar = v;
+    if (sscanf(line, "syscw: %llu", &v) == 1) *syscw = v;
+  }
+  fclose(f);
+}
+
 /*
  * end of helper/utility functions.
  */
@@ -128,6 +190,37 @@ static uint64_t now() {
 #define DEF_FILTER_BITS 10
 #define DEF_KEY_SIZE 8
 #define DEF_VAL_SIZE 32
+#define DEF_CACHE_SHARDS 16
+#define DEF_CACHE_OVERHEAD 64 /* per-entry bookkeeping charged to cache */
+#define DEF_TP_SAMPLE 1000    /* bg pool sampling interval (micros) */
+#define DEF_TP_SATURATED 25   /* % of samples with all bg threads running */
+#define DEF_DRAIN_CHUNK (1 << 20) /* max bytes copied per drain step */
+
+/*
+ * mpi tags for the query service
+ */
+#define TAG_REQ 1 /* query request */
+#define TAG_REP 2 /* query reply */
+#define TAG_FIN 3 /* no more requests from the sender */
+#define TAG_EPOCH 4 /* an epoch has been flushed by the sender */
+#define TAG_AGG 5   /* a batch of records forwarded to the node's writer */
+
+/*
+ * max time a reader waits for a flushed epoch to become queryable
+ */
+#define DEF_QUERYABLE_WAIT 1000000 /* micros */
+
+/*
+ * filter comparison defaults
+ */
+#define DEF_FILTER_STRIDES "1,4,16" /* dense to sparse keys */
+#define DEF_FILTER_QUERIES 1000     /* lookups per rank if no -q given */
+
+/*
+ * predicate scan defaults
+ */
+#define DEF_ENERGY_OFF 8   /* offset of the float energy field in values */
+#define DEF_PSCAN_SAMPLE 3 /* matches shown per rank */
 
 /*
  * gs: shared global data (from the command line)
@@ -148,6 +241,47 @@ struct gs {
   int valsz;
   int iosz;
   int logrotation;
+  int nwriters; /* num of ranks that wrote the plfsdir */
+  int nqueries; /* num of queries per reader rank */
+  int qdepth;   /* max num of outstanding lookups per rank */
+  int nbatch;   /* num of keys per batch query (per reader rank) */
+  const char* keyfile; /* key list for batch queries */
+  long long cachesz;   /* reader-side cache budget in bytes */
+  int hotkeys;         /* num of distinct keys in the repeated workload */
+  int skew;            /* query key skew (0 for uniform) */
+  int absent;          /* percent of hot keys that were never written */
+  int preload;         /* preload index and filter blocks at open */
+  int coldwarm;        /* run reads with a cold and then a warm cache */
+  int nrww;            /* num of ranks reading while others write */
+  int ncycles;         /* num of open/finish cycles to benchmark */
+  int stagger;         /* delay between the opens of adjacent ranks (us) */
+  int precreate;       /* pre-create per-rank subdirs for open cycles */
+  int ndirs;           /* num of plfsdirs written concurrently per rank */
+  int dedicated;       /* give each plfsdir its own bg thread pool */
+  int tpmon;           /* monitor bg thread pool utilization */
+  int vmmon;           /* dirty page sampling interval (ms), 0 for off */
+  int sync;            /* sync the file system at epoch boundaries */
+  const char* drain;   /* drain destination, NULL for no draining */
+  int drainbw;         /* per-rank drain bandwidth (MB/s), 0 for no limit */
+  int zerocopy;        /* drain with copy_file_range */
+  int nodebw;          /* node-wide flush bandwidth (MB/s), 0 for no limit */
+  int aggbatch;        /* records per forwarded batch, 0 for no aggregation */
+  double slowsd;       /* std devs below median to flag a node, 0 for off */
+  int epochgap;        /* pause between epochs (ms) */
+  const char* tenants; /* tenant groups, NULL for a single job */
+  const char* scenario; /* scenario file, NULL for a single write/read */
+  const char* filters; /* filter types to compare, NULL for no comparison */
+  const char* strides; /* key strides (inverse densities) for filter runs */
+  int cksum;           /* compare checksum settings on writes and reads */
+  int amp;             /* account read amplification per query */
+  const char* window;  /* query epoch window, NULL for all epochs */
+  int wlast;           /* window is the last wlast epochs, 0 for a..b */
+  int wfirst;          /* window is epochs wfirst..wend */
+  int wend;
+  int pscan;           /* run predicate scans */
+  float pthres;        /* predicate: energy > pthres */
+  int pthreads;        /* num of predicate scan threads per rank */
+  int skipwrite;
   int timeout;
   int v;
 } g;
@@ -169,10 +303,53 @@ static void usage(const char* msg) {
   fprintf(stderr, "usage: %s [options] plfsdir\n", argv0);
   fprintf(stderr, "\noptions:\n");
   fprintf(stderr, "\t-t sec    timeout (alarm), in seconds\n");
+  fprintf(stderr, "\t-q num    num of queries per reader rank\n");
+  fprintf(stderr, "\t-w num    num of writer ranks that produced plfsdir\n");
+  fprintf(stderr, "\t-Q num    max num of outstanding lookups per rank\n");
+  fprintf(stderr, "\t-B num    num of random keys per batch query\n");
+  fprintf(stderr, "\t-i file   key list for batch queries\n");
+  fprintf(stderr, "\t-C bytes  reader-side cache size\n");
+  fprintf(stderr, "\t-H num    num of hot keys in repeated queries\n");
+  fprintf(stderr, "\t-I skew   query key skew, 0 for uniform\n");
+  fprintf(stderr, "\t-l pct    percent of hot keys that are absent\n");
+  fprintf(stderr, "\t-P        compare index/filter preloading with lazy\n");
+  fprintf(stderr, "\t-o        run reads with a cold and a warm cache\n");
+  fprintf(stderr, "\t-R num    num of ranks querying while others write\n");
+  fprintf(stderr, "\t-O num    num of open/finish cycles to benchmark\n");
+  fprintf(stderr, "\t-S us     stagger opens across ranks by us per rank\n");
+  fprintf(stderr, "\t-p        pre-create per-rank subdirs for -O cycles\n");
+  fprintf(stderr, "\t-D num    num of plfsdirs written concurrently\n");
+  fprintf(stderr, "\t-J        use one bg thread pool per plfsdir\n");
+  fprintf(stderr, "\t-u        monitor bg thread pool utilization\n");
+  fprintf(stderr, "\t-m ms     sample dirty pages and writeback every ms\n");
+  fprintf(stderr, "\t-y        sync the file system at epoch boundaries\n");
+  fprintf(stderr, "\t-T dir    drain plfsdir files to dir in the bg\n");
+  fprintf(stderr, "\t-L mbps   drain bandwidth limit per rank in MB/s\n");
+  fprintf(stderr, "\t-Z        drain with zero-copy (copy_file_range)\n");
+  fprintf(stderr, "\t-N mbps   node-wide epoch flush bandwidth in MB/s\n");
+  fprintf(stderr, "\t-A num    forward records to node writers, num a batch\n");
+  fprintf(stderr, "\t-G sd     report per node, flag nodes sd below median\n");
+  fprintf(stderr, "\t-E ms     pause between epochs\n");
+  fprintf(stderr, "\t-F file   run the phases listed in a scenario file\n");
+  fprintf(stderr, "\t-K k=v    set a plfsdir conf key (repeatable), "
+                  "d:k=v for plfsdir d of -D only\n");
+  fprintf(stderr, "\t-c file   load plfsdir conf keys from file\n");
+  fprintf(stderr, "\t-U list   compare filters, list is type[:bm_fmt],...\n");
+  fprintf(stderr, "\t-W list   key strides for filter comparison\n");
+  fprintf(stderr, "\t-X        compare checksum costs on writes and reads\n");
+  fprintf(stderr, "\t-a        account storage reads and bytes per query\n");
+  fprintf(stderr, "\t-V win    query only the last win epochs, or a..b\n");
+  fprintf(stderr, "\t-Y thres  scan for values with energy > thres\n");
+  fprintf(stderr, "\t-z num    num of predicate scan threads per rank\n");
+  fprintf(stderr, "\t-M spec   run tenant groups, spec is "
+                  "nranks:iosz:valsz:gap[,...]\n");
+  fprintf(stderr, "\t-x        skip the write phase (read existing plfsdir)\n");
   fprintf(stderr, "\t-v        be verbose\n");
   exit(1);
 }
 
+static std::string cfstr(int rank, int d);
+
 /*
  * printopts: print global options
  */
@@ -188,6 +365,47 @@ static void printopts() {
   printf("\tfilter bits per key: %d\n", g.filterbits);
   printf("\tio size: %d\n", g.iosz);
   printf("\tlog rotation: %d\n", g.logrotation);
+  printf("\tplfsdir conf: %s\n", cfstr(g.myrank, 0).c_str());
+  for (int d = 1; d < g.ndirs; d++) {
+    printf("\tplfsdir %d conf: %s\n", d, cfstr(g.myrank, d).c_str());
+  }
+  printf("\tskip write: %d\n", g.skipwrite);
+  printf("\tnum writers: %d\n", g.nwriters);
+  printf("\tnum queries: %d (per reader)\n", g.nqueries);
+  printf("\tmax query depth: %d\n", g.qdepth);
+  printf("\tbatch size: %d (per reader)\n", g.nbatch);
+  printf("\tkey list: %s\n", g.keyfile ? g.keyfile : "(none)");
+  printf("\tcache size: %lld bytes\n", g.cachesz);
+  printf("\thot keys: %d (per reader)\n", g.hotkeys);
+  printf("\tabsent hot keys: %d%%\n", g.absent);
+  printf("\tquery key skew: %d\n", g.skew);
+  printf("\tpreload: %d\n", g.preload);
+  printf("\tcold and warm reads: %d\n", g.coldwarm);
+  printf("\tread while write ranks: %d\n", g.nrww);
+  printf("\topen/finish cycles: %d\n", g.ncycles);
+  printf("\topen stagger: %d us\n", g.stagger);
+  printf("\tpre-create subdirs: %d\n", g.precreate);
+  printf("\tnum plfsdirs: %d\n", g.ndirs);
+  printf("\tdedicated bg pools: %d\n", g.dedicated);
+  printf("\tbg pool monitor: %d\n", g.tpmon);
+  printf("\tdirty page sampling: %d ms\n", g.vmmon);
+  printf("\tsync at epoch boundaries: %d\n", g.sync);
+  printf("\tdrain to: %s\n", g.drain ? g.drain : "(none)");
+  printf("\tdrain bandwidth limit: %d MB/s (per rank)\n", g.drainbw);
+  printf("\tzero-copy drain: %d\n", g.zerocopy);
+  printf("\tnode flush bandwidth limit: %d MB/s\n", g.nodebw);
+  printf("\taggregation batch: %d records\n", g.aggbatch);
+  printf("\tslow node threshold: %.2f std devs\n", g.slowsd);
+  printf("\tepoch gap: %d ms\n", g.epochgap);
+  printf("\ttenants: %s\n", g.tenants ? g.tenants : "(none)");
+  printf("\tscenario: %s\n", g.scenario ? g.scenario : "(none)");
+  printf("\tfilter comparison: %s\n", g.filters ? g.filters : "(none)");
+  printf("\tfilter key strides: %s\n", g.strides);
+  printf("\tchecksum comparison: %d\n", g.cksum);
+  printf("\tread amplification: %d\n", g.amp);
+  printf("\tquery window: %s\n", g.window ? g.window : "(all epochs)");
+  printf("\tpredicate scan: %d (energy > %g)\n", g.pscan, g.pthres);
+  printf("\tpredicate scan threads: %d\n", g.pthreads);
   printf("\tbbos: %d\n", g.bbos);
   printf("\tbbos proto: %s\n", g.bbosproto);
   printf("\tbbos hostname: %s\n", g.bboshostname);
@@ -227,188 +445,3996 @@ static void mkbbos() {
 }
 
 /*
- * mkconf: generate plfsdir conf
+ * pm: bg thread pool monitor. deltafs pools are opaque, so pool threads
+ * are found by diffing /proc/self/task before and after a pool is
+ * created, and then sampled from /proc/self/task/<tid>/{stat,schedstat}
+ * by a monitor thread.
+ */
+static struct pm {
+  pthread_t th;
+  pthread_mutex_t mu;
+  std::map<deltafs_tp_t*, std::vector<int> > pools; /* threads per pool */
+  std::vector<int> tids;     /* threads of the pools being monitored */
+  std::vector<uint64_t> run; /* per-thread cpu time at last mark (ns) */
+  std::vector<uint64_t> busy; /* per-thread cpu time since start (ns) */
+  uint64_t wait;  /* run queue wait at last mark (ns) */
+  uint64_t mark;  /* time of last mark */
+  uint64_t start;
+  uint64_t nsamples;
+  uint64_t nrunning; /* sum of running pool threads over all samples */
+  uint64_t nsaturated; /* samples with all pool threads running */
+  int peak;            /* threads needed by the busiest epoch */
+  int stop;
+} pm;
+
+/*
+ * lstasks: list the ids of all threads of the calling process
+ */
+static void lstasks(std::vector<int>* tids) {
+  struct dirent* ent;
+  DIR* d;
+
+  d = opendir("/proc/self/task");
+  while (d && (ent = readdir(d)) != NULL) {
+    if (ent->d_name[0] != '.') tids->push_back(atoi(ent->d_name));
+  }
+  if (d) closedir(d);
+  std::sort(tids->begin(), tids->end());
+}
+
+/*
+ * taskstat: get the state, the cpu time, and the run queue wait time
+ * (both in ns) of a thread of the calling process
+ */
+static void taskstat(int tid, char* state, uint64_t* run, uint64_t* wait) {
+  unsigned long long a, b;
+  char path[50];
+  char buf[200];
+  char* p;
+  FILE* f;
+
+  *state = '?';
+  *run = *wait = 0;
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+  f = fopen(path, "r");
+  if (f) {
+    /* the state follows the thread name, which may contain spaces */
+    if (fgets(buf, sizeof(buf), f) && (p = strrchr(buf, ')')) != NULL)
+      *state = p[2];
+    fclose(f);
+  }
+  snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+  f = fopen(path, "r");
+  if (f) {
+    if (fscanf(f, "%llu %llu", &a, &b) == 2) {
+      *run = a;
+      *wait = b;
+    }
+    fclose(f);
+  }
+}
+
+/*
+ * mkpool: create a bg thread pool and note the threads it brings in.
+ * pools must be closed with rmpool().
+ */
+static deltafs_tp_t* mkpool(int n) {
+  std::vector<int> before;
+  std::vector<int> after;
+  deltafs_tp_t* tp;
+
+  lstasks(&before);
+  tp = deltafs_tp_init(n);
+  if (!tp) complain("fail to init thread pool");
+  lstasks(&after);
+  for (size_t i = 0; i < after.size(); i++) {
+    if (!std::binary_search(before.begin(), before.end(), after[i])) {
+      pm.pools[tp].push_back(after[i]);
+    }
+  }
+
+  return tp;
+}
+
+/*
+ * rmpool: close a bg thread pool created by mkpool()
+ */
+static void rmpool(deltafs_tp_t* tp) {
+  pm.pools.erase(tp);
+  deltafs_tp_close(tp);
+}
+
+/*
+ * pmadd: monitor the threads of a live pool
+ */
+static void pmadd(deltafs_tp_t* tp) {
+  std::vector<int>* tids = &pm.pools[tp];
+  pm.tids.insert(pm.tids.end(), tids->begin(), tids->end());
+}
+
+/*
+ * pmloop: sample the state of all pool threads until told to stop
  */
-static void mkconf() {
+static void* pmloop(void* arg) {
+  uint64_t run;
+  uint64_t wait;
+  char state;
   int n;
 
-  if (g.bg && !bgp) bgp = deltafs_tp_init(g.bg);
-  if (g.bg && !bgp) complain("fail to init thread pool");
-
-  n = snprintf(cf, sizeof(cf), "rank=%d", g.myrank);
-  n += snprintf(cf + n, sizeof(cf) - n, "&tail_padding=1&block_padding=1");
-  n += snprintf(cf + n, sizeof(cf) - n, "&data_buffer=%d", g.iosz);
-  n += snprintf(cf + n, sizeof(cf) - n, "&min_data_buffer=%d", g.iosz);
-  n += snprintf(cf + n, sizeof(cf) - n, "&index_buffer=%d", g.iosz);
-  n += snprintf(cf + n, sizeof(cf) - n, "&min_index_buffer=%d", g.iosz);
-  n += snprintf(cf + n, sizeof(cf) - n, "&key_size=%d", g.keysz);
-  n += snprintf(cf + n, sizeof(cf) - n, "&value_size=%d", g.valsz);
-  n += snprintf(cf + n, sizeof(cf) - n, "&bf_bits_per_key=%d", g.filterbits);
-  n +=
-      snprintf(cf + n, sizeof(cf) - n, "&epoch_log_rotation=%d", g.logrotation);
-  snprintf(cf + n, sizeof(cf) - n, "&lg_parts=%d", 0);
+  pthread_mutex_lock(&pm.mu);
+  while (!pm.stop) {
+    pthread_mutex_unlock(&pm.mu);
+    n = 0;
+    for (size_t i = 0; i < pm.tids.size(); i++) {
+      taskstat(pm.tids[i], &state, &run, &wait);
+      if (state == 'R') n++;
+    }
+    pthread_mutex_lock(&pm.mu);
+    pm.nsamples++;
+    pm.nrunning += n;
+    if (n && n == int(pm.tids.size())) pm.nsaturated++;
+    pthread_mutex_unlock(&pm.mu);
+    usleep(DEF_TP_SAMPLE);
+    pthread_mutex_lock(&pm.mu);
+  }
+  pthread_mutex_unlock(&pm.mu);
 
-#ifndef NDEBUG
-  info(cf);
-#endif
+  return NULL;
 }
 
 /*
- * writekey: write a key into plfsdir
+ * pmcpu: get the total cpu and run queue wait time of all pool threads
+ * and update per-thread busy times
  */
-static void writekey(int k, int e, const std::string& v) {
-  char fname[20];
+static uint64_t pmcpu(uint64_t* waitsum) {
+  uint64_t sum;
+  uint64_t run;
+  uint64_t wait;
+  char state;
+
+  sum = *waitsum = 0;
+  for (size_t i = 0; i < pm.tids.size(); i++) {
+    taskstat(pm.tids[i], &state, &run, &wait);
+    if (run >= pm.run[i]) pm.busy[i] += run - pm.run[i];
+    pm.run[i] = run;
+    sum += run;
+    *waitsum += wait;
+  }
+
+  return sum;
+}
+
+/*
+ * pmstart: start monitoring the bg thread pool(s)
+ */
+static void pmstart() {
   int r;
 
-  assert(dir != NULL);
+  pm.run.assign(pm.tids.size(), 0);
+  pm.busy.assign(pm.tids.size(), 0);
+  pmcpu(&pm.wait);
+  pm.busy.assign(pm.tids.size(), 0);
+  pm.nsamples = pm.nrunning = pm.nsaturated = 0;
+  pm.peak = 0;
+  pm.stop = 0;
+  pm.mark = pm.start = now();
+  pthread_mutex_init(&pm.mu, NULL);
+  r = pthread_create(&pm.th, NULL, pmloop, NULL);
+  if (r) complain("fail to create monitor thread: %s", strerror(r));
+}
 
-  snprintf(fname, sizeof(fname), "f%08x-r%08x", k, g.myrank);
-  r = deltafs_plfsdir_append(dir, fname, e, v.data(), v.size());
-  if (r) complain("error writing %s: %s", fname, strerror(errno));
+/*
+ * pmepoch: report bg pool utilization since the previous mark. must be
+ * called by all writer ranks.
+ */
+static void pmepoch(int e) {
+  uint64_t before;
+  uint64_t wait;
+  uint64_t wall;
+  double v[3]; /* utilization, run queue wait, threads needed */
+  double avg[3];
+  double max[3];
+  int rank;
+  int r;
+
+  before = std::accumulate(pm.run.begin(), pm.run.end(), uint64_t(0));
+  v[0] = double(pmcpu(&wait) - before);
+  wall = (now() - pm.mark) * 1000;
+  if (!wall) wall = 1;
+  v[2] = v[0] / wall;
+  v[1] = double(wait - pm.wait) / 1000000;
+  v[0] = pm.tids.empty() ? 0 : v[0] * 100 / (wall * pm.tids.size());
+  pm.wait = wait;
+  pm.mark = now();
+  if (int(v[2] + 0.999) > pm.peak) pm.peak = int(v[2] + 0.999);
+
+  MPI_Comm_rank(comm, &rank);
+  r = MPI_Reduce(v, avg, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(v, max, 3, MPI_DOUBLE, MPI_MAX, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (!rank) {
+    MPI_Comm_size(comm, &r);
+    printf("\tepoch %d bg pool: %.1f%% busy (max %.1f%%), %.3f ms run queue"
+           " wait, %.2f threads needed (max %.2f)\n",
+           e, avg[0] / r, max[0], avg[1] / r, avg[2] / r, max[2]);
+  }
 }
 
 /*
- * writepoch: insert epoch data into plfsdir
+ * pmstop: stop monitoring and report per-thread utilization along with
+ * a recommended bg thread count
  */
-static void writepoch(int e) {
-  std::string v;
+static void pmstop() {
+  std::vector<double> u;
+  uint64_t wall;
+  uint64_t s[3]; /* samples, running threads, saturated samples */
+  int nthreads;
+  int rank;
+  int sz;
   int r;
 
-  assert(dir != NULL);
+  pthread_mutex_lock(&pm.mu);
+  pm.stop = 1;
+  pthread_mutex_unlock(&pm.mu);
+  pthread_join(pm.th, NULL);
+  pthread_mutex_destroy(&pm.mu);
 
-  v.resize(g.valsz, '.');
-  for (int i = 0; i < g.nkeys; i++) {
-    writekey(i, e, v);
+  wall = (now() - pm.start) * 1000;
+  nthreads = int(pm.tids.size());
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &sz);
+  r = MPI_Allreduce(MPI_IN_PLACE, &nthreads, 1, MPI_INT, MPI_MIN, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi allreduce");
+  for (int i = 0; i < nthreads; i++) {
+    u.push_back(double(pm.busy[i]) * 100 / (wall ? wall : 1) / sz);
   }
+  r = MPI_Reduce(rank ? u.data() : MPI_IN_PLACE, u.data(), nthreads,
+                 MPI_DOUBLE, MPI_SUM, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  s[0] = pm.nsamples;
+  s[1] = pm.nrunning;
+  s[2] = pm.nsaturated;
+  r = MPI_Reduce(rank ? s : MPI_IN_PLACE, s, 3, MPI_UINT64_T, MPI_SUM, 0,
+                 comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(rank ? &pm.peak : MPI_IN_PLACE, &pm.peak, 1, MPI_INT,
+                 MPI_MAX, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (rank) return;
 
-  r = MPI_Barrier(MPI_COMM_WORLD);
-  if (r != MPI_SUCCESS) complain("fail to do mpi barrier");
-  r = deltafs_plfsdir_epoch_flush(dir, e);
-  if (r) complain("error flushing dir: %s", strerror(errno));
+  for (int i = 0; i < nthreads; i++) {
+    printf("\tbg thread %d: %.1f%% busy (avg over ranks)\n", i, u[i]);
+  }
+  if (!s[0]) s[0] = 1;
+  printf("\tbg pool: %.2f threads running on avg, saturated in %.1f%% of "
+         "samples\n",
+         double(s[1]) / s[0], double(s[2]) * 100 / s[0]);
+  /* the busiest epoch sets the size, plus one if work kept queueing */
+  if (double(s[2]) * 100 / s[0] > DEF_TP_SATURATED) pm.peak++;
+  printf("\trecommended bg threads: %d\n", std::max(pm.peak, 1));
 }
 
 /*
- * write: insert data into plfsdir as multiple epochs
+ * ck: a plfsdir conf key and the type of its values. enum values are
+ * listed in vals separated by '|'. fractions are floats in (0, 1].
  */
-static void write() {
-  int r;
-  if (g.bbos) mkbbos();
-  mkconf();
-  dir = deltafs_plfsdir_create_handle(cf, O_WRONLY);
-  deltafs_plfsdir_set_err_printer(dir, printerr, NULL);
-  if (bgp) deltafs_plfsdir_set_thread_pool(dir, bgp);
-  if (env) deltafs_plfsdir_set_env(dir, env);
-
-  r = deltafs_plfsdir_open(dir, g.dirname);
-  if (r) complain("error opening dir: %s", strerror(errno));
-  for (int e = 0; e < g.nepochs; e++) {
-    writepoch(e);
+enum { CK_INT, CK_BOOL, CK_FLOAT, CK_FRAC, CK_ENUM };
+static const struct ck {
+  const char* key;
+  int type;
+  const char* vals;
+} cks[] = {
+    {"lg_parts", CK_INT, NULL},
+    {"memtable_size", CK_INT, NULL},
+    {"compaction_buffer", CK_INT, NULL},
+    {"data_buffer", CK_INT, NULL},
+    {"min_data_buffer", CK_INT, NULL},
+    {"index_buffer", CK_INT, NULL},
+    {"min_index_buffer", CK_INT, NULL},
+    {"block_size", CK_INT, NULL},
+    {"block_util", CK_FRAC, NULL},
+    {"block_padding", CK_BOOL, NULL},
+    {"block_batch_size", CK_INT, NULL},
+    {"tail_padding", CK_BOOL, NULL},
+    {"key_size", CK_INT, NULL},
+    {"value_size", CK_INT, NULL},
+    {"fixed_kv", CK_BOOL, NULL},
+    {"leveldb_compatible", CK_BOOL, NULL},
+    {"epoch_log_rotation", CK_BOOL, NULL},
+    {"skip_checksums", CK_BOOL, NULL},
+    {"verify_checksums", CK_BOOL, NULL},
+    {"paranoid_checks", CK_BOOL, NULL},
+    {"ignore_filters", CK_BOOL, NULL},
+    {"filter", CK_ENUM, "bloom|bitmap|cuckoo|none"},
+    {"bf_bits_per_key", CK_INT, NULL},
+    {"bm_fmt", CK_ENUM,
+     "uncompressed|roaring|fast-vb+|vb+|vb|fast-pfdelta|pfdelta"},
+    {"bm_key_bits", CK_INT, NULL},
+    {"cuckoo_frac", CK_FLOAT, NULL},
+    {"compression", CK_ENUM, "snappy|none"},
+    {"force_compression", CK_BOOL, NULL},
+};
+
+typedef std::vector<std::pair<std::string, std::string> > kvlist;
+static kvlist cfo; /* conf overrides from the command line or a file */
+static std::map<int, kvlist> dcfo; /* overrides for a single -D plfsdir */
+
+/*
+ * cfput: set a conf key in a list, replacing any previous value
+ */
+static void cfput(kvlist* kvs, const std::string& k, const std::string& v) {
+  for (size_t i = 0; i < kvs->size(); i++) {
+    if ((*kvs)[i].first == k) {
+      (*kvs)[i].second = v;
+      return;
+    }
   }
+  kvs->push_back(std::make_pair(k, v));
+}
 
-  r = deltafs_plfsdir_finish(dir);
-  if (r) complain("error finalizing dir: %s", strerror(errno));
-  deltafs_plfsdir_free_handle(dir);
+static void cfint(kvlist* kvs, const char* k, int v) {
+  char tmp[20];
+
+  snprintf(tmp, sizeof(tmp), "%d", v);
+  cfput(kvs, k, tmp);
 }
 
 /*
- * main program
+ * cfset: validate a key=value conf override and add it to the overrides.
+ * integers may have a k, m, or g suffix. a d: prefix (d:key=value) limits
+ * the override to plfsdir d of -D. return 0 on success, or -1 if the key
+ * is unknown or the value is bad.
  */
-int main(int argc, char* argv[]) {
-  int r, ch;
-  r = MPI_Init(&argc, &argv);
-  if (r != MPI_SUCCESS) complain("fail to init mpi");
-  argv0 = argv[0];
-  memset(cf, 0, sizeof(cf));
-  memset(b.remote, 0, sizeof(b.remote));
-  memset(b.lo, 0, sizeof(b.lo));
-  /* we want lines, even if we are writing to a pipe */
-  setlinebuf(stdout);
+static int cfset(const char* kv) {
+  static const char units[] = "kmg";
+  kvlist* to = &cfo;
+  const char* val;
+  std::string k;
+  char tmp[30];
+  char* end;
+  size_t i;
+  long d;
 
-  memset(&g, 0, sizeof(g));
-  r = MPI_Comm_rank(MPI_COMM_WORLD, &g.myrank);
-  if (r != MPI_SUCCESS) complain("cannot get proc mpi rank");
-  r = MPI_Comm_size(MPI_COMM_WORLD, &g.commsz);
-  if (r != MPI_SUCCESS) complain("cannot get mpi world size");
+  d = strtol(kv, &end, 10);
+  if (end != kv && *end == ':') {
+    if (d < 0) return -1;
+    to = &dcfo[int(d)];
+    kv = end + 1;
+  }
+  val = strchr(kv, '=');
+  if (!val || val == kv || !val[1]) return -1;
+  k.assign(kv, val - kv);
+  val++;
+  for (i = 0; i < sizeof(cks) / sizeof(cks[0]); i++) {
+    if (k == cks[i].key) break;
+  }
+  if (i == sizeof(cks) / sizeof(cks[0])) return -1;
+  switch (cks[i].type) {
+    case CK_INT: {
+      errno = 0;
+      long long n = strtoll(val, &end, 10);
+      if (end == val || n < 0) return -1;
+      const char* p = *end ? strchr(units, tolower(*end)) : NULL;
+      int shift = p ? 10 * int(p - units + 1) : 0;
+      if (errno == ERANGE || n > (INT_MAX >> shift))
+        complain("conf %s=%s is out of range", k.c_str(), val);
+      n <<= shift;
+      if (p) end++;
+      if (*end) return -1;
+      snprintf(tmp, sizeof(tmp), "%lld", n);
+      val = tmp;
+      break;
+    }
+    case CK_BOOL:
+      if (!strcmp(val, "1") || !strcmp(val, "true") || !strcmp(val, "yes"))
+        val = "1";
+      else if (!strcmp(val, "0") || !strcmp(val, "false") ||
+               !strcmp(val, "no"))
+        val = "0";
+      else
+        return -1;
+      break;
+    case CK_FLOAT:
+      if (strtod(val, &end) < 0 || end == val || *end) return -1;
+      break;
+    case CK_FRAC: {
+      double f = strtod(val, &end);
+      if (end == val || *end || !(f > 0 && f <= 1)) return -1;
+      break;
+    }
+    case CK_ENUM: {
+      const char* p = strstr(cks[i].vals, val);
+      size_t n = strlen(val);
+      while (p && !((p == cks[i].vals || p[-1] == '|') &&
+                    (p[n] == '|' || !p[n])))
+        p = strstr(p + 1, val);
+      if (!p) return -1;
+      break;
+    }
+  }
+  cfput(to, k, val);
+  return 0;
+}
 
-  g.nepochs = DEF_NUM_EPOCHS;
-  g.nkeys = DEF_NUM_KEYS_PER_EPOCH;
-  g.filterbits = DEF_FILTER_BITS;
-  g.keysz = DEF_KEY_SIZE;
-  g.valsz = DEF_VAL_SIZE;
-  g.bbosproto = DEF_BBOS_PROTO;
-  g.bboshostname = DEF_BBOS_HOSTNAME;
-  g.bbosport = DEF_BBOS_PORT;
-  g.timeout = DEF_TIMEOUT;
-  g.iosz = DEF_IO_SIZE;
+/*
+ * cfload: load conf overrides from a file with one key=value per line.
+ * spaces around the key and the value are ignored. blank lines and lines
+ * starting with # are skipped.
+ */
+static void cfload(const char* fname) {
+  std::string kv;
+  char line[200];
+  char* val;
+  char* p;
+  FILE* f;
+  int n;
 
-  while ((ch = getopt(argc, argv, "s:e:n:f:k:d:j:t:rvb")) != -1) {
-    switch (ch) {
-      case 's':
-        g.iosz = atoi(optarg);
-        if (g.iosz <= 0) usage("bad io size");
-        break;
-      case 'e':
-        g.nepochs = atoi(optarg);
-        if (g.nepochs < 0) usage("bad epoch nums");
-        break;
-      case 'n':
-        g.nkeys = atoi(optarg);
-        if (g.nkeys < 0) usage("bad key nums");
-        break;
-      case 'f':
-        g.filterbits = atoi(optarg);
-        if (g.filterbits < 0) usage("bad filter bits");
-        break;
-      case 'k':
-        g.keysz = atoi(optarg);
-        if (g.keysz <= 0) usage("bad key size");
-        break;
-      case 'd':
-        g.valsz = atoi(optarg);
-        if (g.valsz < 0) usage("bad value size");
-        break;
-      case 'j':
-        g.bg = atoi(optarg);
-        if (g.bg < 0) usage("bad bg number");
-        break;
-      case 't':
-        g.timeout = atoi(optarg);
-        if (g.timeout < 0) usage("bad timeout");
-        break;
-      case 'r':
-        g.logrotation = 1;
-        break;
-      case 'b':
-        g.bbos = 1;
-        break;
-      case 'v':
-        g.v = 1;
-        break;
-      default:
-        usage(NULL);
+  f = fopen(fname, "r");
+  if (!f) complain("cannot open conf %s: %s", fname, strerror(errno));
+  for (n = 1; fgets(line, sizeof(line), f); n++) {
+    p = line + strspn(line, " \t");
+    p[strcspn(p, "\r\n")] = 0;
+    if (!p[0] || p[0] == '#') continue;
+    kv.clear();
+    val = strchr(p, '=');
+    if (val) {
+      *val++ = 0;
+      val += strspn(val, " \t");
     }
+    /* drop spaces before the '=' and after the value */
+    kv.assign(p, p + strcspn(p, " \t"));
+    if (val) kv += "=" + std::string(val, strcspn(val, " \t"));
+    if (cfset(kv.c_str()) != 0)
+      complain("%s:%d: bad conf %s", fname, n, kv.c_str());
   }
-  argc -= optind;
-  argv += optind;
+  fclose(f);
+}
 
-  if (argc == 0) /* plfsdir must be provided on command line */
-    usage("bad args");
-  g.dirname = argv[0];
-  if (argc > 1) g.bboshostname = argv[1];
-  if (argc > 2) g.bbosport = atoi(argv[2]);
-  if (g.bbosport <= 0) usage("bad bbos port");
-  printopts();
+/*
+ * cfstr: get the conf of plfsdir d (of -D) for a given partition (writer
+ * rank). the runner's own settings come first and can be overridden by
+ * the user, first for all plfsdirs and then for plfsdir d.
+ */
+static std::string cfstr(int rank, int d) {
+  std::string rv;
+  kvlist kvs;
+  char tmp[20];
 
-  signal(SIGALRM, sigalarm);
-  alarm(g.timeout);
+  cfint(&kvs, "tail_padding", 1);
+  cfint(&kvs, "block_padding", 1);
+  cfint(&kvs, "data_buffer", g.iosz);
+  cfint(&kvs, "min_data_buffer", g.iosz);
+  cfint(&kvs, "index_buffer", g.iosz);
+  cfint(&kvs, "min_index_buffer", g.iosz);
+  cfint(&kvs, "key_size", g.keysz);
+  cfint(&kvs, "value_size", g.valsz);
+  cfint(&kvs, "bf_bits_per_key", g.filterbits);
+  cfint(&kvs, "epoch_log_rotation", g.logrotation);
+  cfint(&kvs, "lg_parts", 0);
+  for (size_t i = 0; i < cfo.size(); i++) {
+    cfput(&kvs, cfo[i].first, cfo[i].second);
+  }
+  if (dcfo.count(d)) {
+    const kvlist& o = dcfo[d];
+    for (size_t i = 0; i < o.size(); i++) cfput(&kvs, o[i].first, o[i].second);
+  }
 
-  dir = NULL;
-  env = NULL;
-  bgp = NULL;
+  snprintf(tmp, sizeof(tmp), "rank=%d", rank);
+  rv = tmp;
+  for (size_t i = 0; i < kvs.size(); i++) {
+    rv += "&" + kvs[i].first + "=" + kvs[i].second;
+  }
 
-  if (g.v && !g.myrank) info("test begins ...");
-  MPI_Barrier(MPI_COMM_WORLD);
-  write();
+  return rv;
+}
+
+/*
+ * mkconf: generate plfsdir conf for a given partition (writer rank)
+ */
+static void mkconf(int rank) {
+  if (g.bg && !bgp) bgp = mkpool(g.bg);
+
+  cf = cfstr(rank, 0);
+
+#ifndef NDEBUG
+  info("%s", cf.c_str());
+#endif
+}
+
+/*
+ * lsparts: list the files of a plfsdir partition (writer rank). this
+ * only works for plfsdirs stored in a local or posix file system.
+ */
+static void lsparts(const std::string& dirname, int w,
+                    std::vector<std::string>* files) {
+  struct dirent* ent;
+  char prefix[20];
+  DIR* d;
+
+  snprintf(prefix, sizeof(prefix), "L-%08x", w);
+  d = opendir(dirname.c_str());
+  if (!d) complain("cannot open %s: %s", dirname.c_str(), strerror(errno));
+  while ((ent = readdir(d)) != NULL) {
+    if (strncmp(ent->d_name, prefix, strlen(prefix)) == 0) {
+      files->push_back(dirname + "/" + ent->d_name);
+    }
+  }
+  closedir(d);
+}
+
+/*
+ * mkdirs: create a directory along with all its missing parents
+ */
+static int mkdirs(const std::string& path) {
+  size_t pos = 0;
+  int n = 0; /* num of dirs created */
+
+  while (pos != std::string::npos) {
+    pos = path.find('/', pos + 1);
+    if (mkdir(path.substr(0, pos).c_str(), 0755) == 0) {
+      n++;
+    } else if (errno != EEXIST) {
+      complain("cannot mkdir %s: %s", path.substr(0, pos).c_str(),
+               strerror(errno));
+    }
+  }
+
+  return n;
+}
+
+static deltafs_plfsdir_t* tryopen(int w);
+static std::string dirpath(int d);
+static void report(const char* name, std::vector<uint64_t>* lat,
+                   uint64_t dura);
+
+/*
+ * dr: bg drainer copying the files of the caller's plfsdir partitions
+ * from a fast staging path (the plfsdir) to a slower destination while
+ * later epochs are being written. plfsdir files are append-only logs,
+ * so each drain pass copies whatever was appended since the previous
+ * pass, and files created by log rotation (-r) are picked up as they
+ * appear. a drain pass is requested after each epoch flush and once
+ * more after the plfsdir is finished.
+ */
+static struct dr {
+  pthread_t th;
+  pthread_mutex_t mu;
+  pthread_cond_t cv;
+  std::map<std::string, uint64_t> off; /* bytes drained per file */
+  uint64_t bytes;       /* bytes drained */
+  uint64_t overlapped;  /* bytes drained before ingest ended */
+  uint64_t busy;        /* micros spent draining */
+  uint64_t ingestend;   /* 0 while ingest is in progress */
+  uint64_t end;         /* time the final pass ended */
+  int pending;          /* drain passes requested */
+  int done;             /* no more passes after the pending ones */
+} dr;
+
+/*
+ * drcopy: copy a byte range between two files
+ */
+static ssize_t drcopy(int in, int out, off_t off, size_t n) {
+  static char buf[DEF_DRAIN_CHUNK];
+  ssize_t nr;
+
+  if (g.zerocopy) {
+    loff_t a = off, b = off;
+    nr = copy_file_range(in, &a, out, &b, n, 0);
+    if (nr >= 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL))
+      return nr;
+  }
+  nr = pread(in, buf, std::min(n, sizeof(buf)), off);
+  if (nr > 0) nr = pwrite(out, buf, nr, off);
+  return nr;
+}
+
+/*
+ * drpass: drain all data appended to the caller's files since the last
+ * pass, honoring the bandwidth limit
+ */
+static void drpass() {
+  std::vector<std::string> files;
+  std::string path;
+  std::string src;
+  std::string dst;
+  struct stat st;
+  uint64_t t;
+  uint64_t o;
+  ssize_t n;
+  int in;
+  int out;
+
+  for (int d = 0; d < g.ndirs; d++) {
+    files.clear();
+    src = dirpath(d);
+    lsparts(src, g.myrank, &files);
+    /* plfsdir x/y is drained to dest/y */
+    dst = std::string(g.drain) + "/" + src.substr(src.rfind('/') + 1);
+    if (!files.empty()) mkdirs(dst);
+    for (size_t i = 0; i < files.size(); i++) {
+      in = open(files[i].c_str(), O_RDONLY);
+      if (in == -1 || fstat(in, &st) == -1)
+        complain("cannot open %s: %s", files[i].c_str(), strerror(errno));
+      /* a file's first pass drops stale bytes left by earlier runs */
+      path = dst + files[i].substr(src.size());
+      out = open(path.c_str(),
+                 O_WRONLY | O_CREAT | (dr.off.count(files[i]) ? 0 : O_TRUNC),
+                 0644);
+      if (out == -1)
+        complain("cannot open %s: %s", path.c_str(), strerror(errno));
+      o = dr.off[files[i]];
+      while (o < uint64_t(st.st_size)) {
+        t = now();
+        n = drcopy(in, out, off_t(o), std::min(uint64_t(DEF_DRAIN_CHUNK),
+                                               st.st_size - o));
+        if (n <= 0) complain("error draining %s: %s", files[i].c_str(),
+                             strerror(errno));
+        o += n;
+        if (g.drainbw) { /* wait until we are back under the limit */
+          uint64_t spent = now() - t;
+          uint64_t want = uint64_t(n) / g.drainbw; /* MB/s == bytes/us */
+          if (want > spent) usleep(useconds_t(want - spent));
+        }
+        pthread_mutex_lock(&dr.mu);
+        dr.bytes += n;
+        if (!dr.ingestend) dr.overlapped += n;
+        pthread_mutex_unlock(&dr.mu);
+      }
+      dr.off[files[i]] = o;
+      close(out);
+      close(in);
+    }
+  }
+}
+
+/*
+ * drloop: run drain passes as they are requested
+ */
+static void* drloop(void* arg) {
+  uint64_t t;
+
+  pthread_mutex_lock(&dr.mu);
+  for (;;) {
+    while (!dr.pending && !dr.done) pthread_cond_wait(&dr.cv, &dr.mu);
+    if (!dr.pending) break;
+    dr.pending = 0;
+    pthread_mutex_unlock(&dr.mu);
+    t = now();
+    drpass();
+    pthread_mutex_lock(&dr.mu);
+    dr.busy += now() - t;
+  }
+  dr.end = now();
+  pthread_mutex_unlock(&dr.mu);
+
+  return NULL;
+}
+
+/*
+ * drstart: start the drainer
+ */
+static void drstart() {
+  int r;
+
+  dr.off.clear();
+  dr.bytes = dr.overlapped = dr.busy = 0;
+  dr.ingestend = dr.end = 0;
+  dr.pending = dr.done = 0;
+  pthread_mutex_init(&dr.mu, NULL);
+  pthread_cond_init(&dr.cv, NULL);
+  r = pthread_create(&dr.th, NULL, drloop, NULL);
+  if (r) complain("fail to create drain thread: %s", strerror(r));
+}
+
+/*
+ * drkick: request a drain pass
+ */
+static void drkick() {
+  pthread_mutex_lock(&dr.mu);
+  dr.pending = 1;
+  pthread_cond_signal(&dr.cv);
+  pthread_mutex_unlock(&dr.mu);
+}
+
+/*
+ * drstop: mark the end of ingest, wait for the final drain pass, and
+ * report how much of the drain overlapped with ingest
+ */
+static void drstop() {
+  uint64_t v[4]; /* bytes, overlapped bytes, busy time, final drain lag */
+  uint64_t sums[2];
+  uint64_t maxs[2];
+  int rank;
+  int r;
+
+  pthread_mutex_lock(&dr.mu);
+  dr.ingestend = now();
+  dr.pending = 1;
+  dr.done = 1;
+  pthread_cond_signal(&dr.cv);
+  pthread_mutex_unlock(&dr.mu);
+  pthread_join(dr.th, NULL);
+  pthread_cond_destroy(&dr.cv);
+  pthread_mutex_destroy(&dr.mu);
+
+  v[0] = dr.bytes;
+  v[1] = dr.overlapped;
+  v[2] = dr.busy;
+  v[3] = dr.end - dr.ingestend;
+  MPI_Comm_rank(comm, &rank);
+  r = MPI_Reduce(v, sums, 2, MPI_UINT64_T, MPI_SUM, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(v + 2, maxs, 2, MPI_UINT64_T, MPI_MAX, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (rank) return;
+  printf("\n==drain results:\n");
+  printf("\tdrained: %llu bytes to %s, %.1f%% during ingest\n",
+         (unsigned long long)sums[0], g.drain,
+         sums[0] ? double(sums[1]) * 100 / sums[0] : 0.0);
+  printf("\tdrain busy: %.3f s (max rank), %.1f MB/s\n",
+         double(maxs[0]) / 1000000, double(sums[0]) / (maxs[0] + 1));
+  printf("\tfinal drain done %.3f s after ingest ended\n",
+         double(maxs[1]) / 1000000);
+}
+
+/*
+ * nb: node-wide token bucket for epoch flushes. ranks on the same node
+ * share the time at which the node's flush bandwidth is next free through
+ * an mpi-3 shared memory window hosted by the node's first rank. a rank
+ * reserves a slot sized by the bytes it is about to flush and waits until
+ * the slot starts, so that flushes are staggered rather than all issued
+ * at the barrier.
+ */
+static struct nb {
+  MPI_Comm node;
+  MPI_Win win;
+  int64_t* next; /* time (micros) at which the node bandwidth is free */
+  uint64_t waittime;
+} nb;
+
+static void nbstart() {
+  MPI_Aint sz;
+  int disp;
+  int rank;
+  int r;
+
+  r = MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+                          &nb.node);
+  if (r != MPI_SUCCESS) complain("fail to split node comm");
+  MPI_Comm_rank(nb.node, &rank);
+  r = MPI_Win_allocate_shared(rank ? 0 : sizeof(int64_t), sizeof(int64_t),
+                              MPI_INFO_NULL, nb.node, &nb.next, &nb.win);
+  if (r != MPI_SUCCESS) complain("fail to allocate shared window");
+  r = MPI_Win_shared_query(nb.win, 0, &sz, &disp, &nb.next);
+  if (r != MPI_SUCCESS) complain("fail to query shared window");
+  if (!rank) {
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, nb.win);
+    *nb.next = 0;
+    MPI_Win_unlock(0, nb.win);
+  }
+  nb.waittime = 0;
+  r = MPI_Barrier(nb.node);
+  if (r != MPI_SUCCESS) complain("fail to do mpi barrier");
+}
+
+/*
+ * nbwait: reserve node bandwidth for flushing the given number of bytes
+ * and sleep until the reserved slot begins
+ */
+static void nbwait(uint64_t bytes) {
+  int64_t start;
+  int64_t t;
+
+  t = int64_t(now());
+  MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, nb.win);
+  MPI_Win_sync(nb.win);
+  start = std::max(t, *nb.next);
+  *nb.next = start + int64_t(bytes / g.nodebw); /* MB/s == bytes/us */
+  MPI_Win_sync(nb.win);
+  MPI_Win_unlock(0, nb.win);
+  if (start > t) {
+    usleep(useconds_t(start - t));
+    nb.waittime += uint64_t(start - t);
+  }
+}
+
+static void nbstop() {
+  MPI_Win_free(&nb.win);
+  MPI_Comm_free(&nb.node);
+}
+
+/*
+ * ds: per-plfsdir write stats
+ */
+static struct ds {
+  uint64_t bytes;
+  uint64_t appendtime; /* micros spent in appends */
+  uint64_t flushtime;  /* micros spent in epoch flushes */
+} * dstats;
+
+/* per-epoch latencies (micros) of each rank, flushes include any wait
+ * for node bandwidth */
+static std::vector<uint64_t> epochlat;
+static std::vector<uint64_t> flushlat;
+
+/*
+ * dirpath: get the path of the d-th plfsdir. with more than one plfsdir
+ * per rank, plfsdirs are written to plfsdir.0, plfsdir.1, ...
+ */
+static std::string dirpath(int d) {
+  char tmp[20];
+
+  if (g.ndirs == 1) return g.dirname;
+  snprintf(tmp, sizeof(tmp), ".%d", d);
+  return std::string(g.dirname) + tmp;
+}
+
+/*
+ * writekey: write a key into the d-th plfsdir
+ */
+static void writekey(int d, int k, int src, int e, const char* v,
+                     size_t n) {
+  char fname[20];
+  uint64_t t;
+  int r;
+
+  assert(dirs[d] != NULL);
+
+  snprintf(fname, sizeof(fname), "f%08x-r%08x", k, src);
+  t = now();
+  r = deltafs_plfsdir_append(dirs[d], fname, e, v, n);
+  if (r) complain("error writing %s: %s", fname, strerror(errno));
+  dstats[d].appendtime += now() - t;
+  dstats[d].bytes += n;
+}
+
+/*
+ * ag: n-to-m aggregation. only the first rank of each node opens plfsdir
+ * handles. all other ranks on the node forward their records to it over
+ * mpi in batches of g.aggbatch records, each record being the key, the
+ * source rank, and the value. an empty batch ends a forwarder's epoch.
+ */
+static struct ag {
+  MPI_Comm node;
+  int fwd;    /* this rank forwards its records instead of writing them */
+  int npeers; /* num of forwarders sending to this rank */
+  std::string buf;
+  int nbuf; /* num of records in buf */
+  uint64_t msgs;
+} ag;
+
+static void agstart() {
+  int rank;
+  int r;
+
+  r = MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+                          MPI_INFO_NULL, &ag.node);
+  if (r != MPI_SUCCESS) complain("fail to split node comm");
+  MPI_Comm_rank(ag.node, &rank);
+  MPI_Comm_size(ag.node, &ag.npeers);
+  ag.fwd = rank != 0;
+  ag.npeers = ag.fwd ? 0 : ag.npeers - 1;
+  ag.buf.clear();
+  ag.buf.reserve(size_t(g.aggbatch) * (8 + g.valsz));
+  ag.nbuf = 0;
+  ag.msgs = 0;
+}
+
+/*
+ * agsend: send buffered records to the node's writer
+ */
+static void agsend() {
+  int r;
+
+  r = MPI_Send(ag.buf.data(), int(ag.buf.size()), MPI_BYTE, 0, TAG_AGG,
+               ag.node);
+  if (r != MPI_SUCCESS) complain("fail to forward records");
+  ag.buf.clear();
+  ag.nbuf = 0;
+  ag.msgs++;
+}
+
+static void agput(int k, const std::string& v) {
+  ag.buf.append(reinterpret_cast<char*>(&k), 4);
+  ag.buf.append(reinterpret_cast<char*>(&g.myrank), 4);
+  ag.buf.append(v);
+  if (++ag.nbuf >= g.aggbatch) agsend();
+}
+
+/*
+ * agrecv: append the records forwarded by all peers for an epoch
+ */
+static void agrecv(int e) {
+  std::string msg;
+  MPI_Status st;
+  size_t rec;
+  int done;
+  int n;
+  int r;
+
+  rec = 8 + size_t(g.valsz);
+  done = 0;
+  while (done < ag.npeers) {
+    r = MPI_Probe(MPI_ANY_SOURCE, TAG_AGG, ag.node, &st);
+    if (r != MPI_SUCCESS) complain("fail to probe forwarded records");
+    MPI_Get_count(&st, MPI_BYTE, &n);
+    msg.resize(n);
+    r = MPI_Recv(&msg[0], n, MPI_BYTE, st.MPI_SOURCE, TAG_AGG, ag.node,
+                 MPI_STATUS_IGNORE);
+    if (r != MPI_SUCCESS) complain("fail to recv forwarded records");
+    if (!n) {
+      done++;
+      continue;
+    }
+    for (size_t off = 0; off + rec <= size_t(n); off += rec) {
+      int k;
+      int src;
+      memcpy(&k, &msg[off], 4);
+      memcpy(&src, &msg[off + 4], 4);
+      for (int d = 0; d < g.ndirs; d++) {
+        writekey(d, k, src, e, &msg[off + 8], g.valsz);
+      }
+    }
+  }
+}
+
+static void agstop() { MPI_Comm_free(&ag.node); }
+
+/*
+ * vm: dirty page and writeback monitor. the first writer rank samples
+ * /proc/meminfo and /proc/vmstat of its node during write() so that
+ * writeback spikes can be matched to epoch flushes.
+ */
+struct vmsample {
+  uint64_t t;
+  uint64_t dirty;     /* kB */
+  uint64_t writeback; /* kB */
+  uint64_t thresh;    /* pages, start of dirty throttling */
+  uint64_t bgthresh;  /* pages, start of bg writeback */
+  uint64_t ndirty;    /* pages, dirty + writeback */
+};
+static struct vm {
+  pthread_t th;
+  pthread_mutex_t mu;
+  std::vector<vmsample> samples;
+  std::vector<uint64_t> epochs;  /* start of each epoch */
+  std::vector<uint64_t> flushes; /* start and end of each epoch flush */
+  int stop;
+} vm;
+
+/*
+ * vmread: take a sample of node-wide dirty and writeback counters
+ */
+static void vmread(vmsample* s) {
+  unsigned long long v;
+  char line[100];
+  FILE* f;
+
+  memset(s, 0, sizeof(*s));
+  s->t = now();
+  f = fopen("/proc/meminfo", "r");
+  while (f && fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "Dirty: %llu", &v) == 1) s->dirty = v;
+    if (sscanf(line, "Writeback: %llu", &v) == 1) s->writeback = v;
+  }
+  if (f) fclose(f);
+  f = fopen("/proc/vmstat", "r");
+  while (f && fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "nr_dirty_threshold %llu", &v) == 1) s->thresh = v;
+    if (sscanf(line, "nr_dirty_background_threshold %llu", &v) == 1)
+      s->bgthresh = v;
+    if (sscanf(line, "nr_dirty %llu", &v) == 1) s->ndirty += v;
+    if (sscanf(line, "nr_writeback %llu", &v) == 1) s->ndirty += v;
+  }
+  if (f) fclose(f);
+}
+
+/*
+ * vmloop: sample until told to stop
+ */
+static void* vmloop(void* arg) {
+  vmsample s;
+
+  pthread_mutex_lock(&vm.mu);
+  while (!vm.stop) {
+    pthread_mutex_unlock(&vm.mu);
+    vmread(&s);
+    usleep(useconds_t(g.vmmon) * 1000);
+    pthread_mutex_lock(&vm.mu);
+    vm.samples.push_back(s);
+  }
+  pthread_mutex_unlock(&vm.mu);
+
+  return NULL;
+}
+
+/*
+ * vmsampling: check if the caller is the rank sampling dirty pages
+ */
+static bool vmsampling() {
+  int rank;
+
+  if (!g.vmmon) return false;
+  MPI_Comm_rank(comm, &rank);
+  return rank == 0;
+}
+
+/*
+ * vmstart: start sampling
+ */
+static void vmstart() {
+  int r;
+
+  vm.samples.clear();
+  vm.epochs.clear();
+  vm.flushes.clear();
+  vm.stop = 0;
+  pthread_mutex_init(&vm.mu, NULL);
+  r = pthread_create(&vm.th, NULL, vmloop, NULL);
+  if (r) complain("fail to create monitor thread: %s", strerror(r));
+}
+
+/*
+ * vmstop: stop sampling and report, for each epoch, the peak dirty and
+ * writeback memory during the epoch and during its flush. the kernel
+ * throttles writers once dirty + writeback pages pass halfway between
+ * the bg and the foreground thresholds; time spent in that zone, and
+ * the extra time epochs touching it took over the fastest epoch, are
+ * reported as time lost to throttling.
+ */
+static void vmstop(uint64_t end) {
+  uint64_t peak[4]; /* dirty, writeback, flush dirty, flush writeback */
+  uint64_t throttled;
+  uint64_t fastest;
+  uint64_t lost;
+  uint64_t from;
+  uint64_t to;
+  bool hit;
+  size_t i;
+
+  pthread_mutex_lock(&vm.mu);
+  vm.stop = 1;
+  pthread_mutex_unlock(&vm.mu);
+  pthread_join(vm.th, NULL);
+  pthread_mutex_destroy(&vm.mu);
+
+  printf("\n==dirty page results:\n");
+  vm.epochs.push_back(end);
+  fastest = ~uint64_t(0);
+  for (i = 0; i + 1 < vm.epochs.size(); i++) {
+    fastest = std::min(fastest, vm.epochs[i + 1] - vm.epochs[i]);
+  }
+  throttled = lost = 0;
+  for (i = 0; i + 1 < vm.epochs.size(); i++) {
+    from = vm.epochs[i];
+    to = vm.epochs[i + 1];
+    memset(peak, 0, sizeof(peak));
+    hit = false;
+    for (size_t j = 0; j < vm.samples.size(); j++) {
+      const vmsample& s = vm.samples[j];
+      if (s.t < from || s.t >= to) continue;
+      peak[0] = std::max(peak[0], s.dirty);
+      peak[1] = std::max(peak[1], s.writeback);
+      if (s.t >= vm.flushes[2 * i] && s.t < vm.flushes[2 * i + 1]) {
+        peak[2] = std::max(peak[2], s.dirty);
+        peak[3] = std::max(peak[3], s.writeback);
+      }
+      if (s.thresh && s.ndirty >= (s.thresh + s.bgthresh) / 2) {
+        throttled += g.vmmon * 1000;
+        hit = true;
+      }
+    }
+    if (hit) lost += to - from - fastest;
+    printf("\tepoch %d: dirty %llu kB, writeback %llu kB peak; during flush"
+           " (%.3f s): dirty %llu kB, writeback %llu kB peak%s\n",
+           int(i), (unsigned long long)peak[0], (unsigned long long)peak[1],
+           double(vm.flushes[2 * i + 1] - vm.flushes[2 * i]) / 1000000,
+           (unsigned long long)peak[2], (unsigned long long)peak[3],
+           hit ? " (throttled)" : "");
+  }
+  printf("\t%d samples, %.3f s in dirty throttling, %.3f s lost to it\n",
+         int(vm.samples.size()), double(throttled) / 1000000,
+         double(lost) / 1000000);
+}
+
+/*
+ * ph: per-phase resource usage of write(), accumulated over all epochs.
+ * usage is taken both for the whole process and for the main thread,
+ * so that work done by bg threads shows up as the difference.
+ */
+enum { PH_APPEND, PH_BARRIER, PH_FLUSH, PH_SYNC, PH_FINISH, PH_NUM };
+static const char* phases[PH_NUM] = {"append", "barrier", "flush", "sync",
+                                     "finish"};
+enum { RU_UTIME, RU_STIME, RU_NVCSW, RU_NIVCSW, RU_MAJFLT, RU_MINFLT, RU_NUM };
+static struct ph {
+  double wall; /* secs */
+  double ru[2][RU_NUM]; /* process and main thread */
+} phs[PH_NUM];
+
+/*
+ * phstart: snapshot resource usage at the beginning of a phase
+ */
+static void phstart(struct rusage ru[2], uint64_t* t) {
+  getrusage(RUSAGE_SELF, &ru[0]);
+  getrusage(RUSAGE_THREAD, &ru[1]);
+  *t = now();
+}
+
+/*
+ * phend: charge resource usage since phstart() to a phase
+ */
+static void phend(int p, struct rusage ru[2], uint64_t t) {
+  struct rusage end[2];
+
+  phs[p].wall += double(now() - t) / 1000000;
+  getrusage(RUSAGE_SELF, &end[0]);
+  getrusage(RUSAGE_THREAD, &end[1]);
+  for (int i = 0; i < 2; i++) {
+    double* v = phs[p].ru[i];
+    v[RU_UTIME] += end[i].ru_utime.tv_sec - ru[i].ru_utime.tv_sec +
+                   double(end[i].ru_utime.tv_usec - ru[i].ru_utime.tv_usec) /
+                       1000000;
+    v[RU_STIME] += end[i].ru_stime.tv_sec - ru[i].ru_stime.tv_sec +
+                   double(end[i].ru_stime.tv_usec - ru[i].ru_stime.tv_usec) /
+                       1000000;
+    v[RU_NVCSW] += end[i].ru_nvcsw - ru[i].ru_nvcsw;
+    v[RU_NIVCSW] += end[i].ru_nivcsw - ru[i].ru_nivcsw;
+    v[RU_MAJFLT] += end[i].ru_majflt - ru[i].ru_majflt;
+    v[RU_MINFLT] += end[i].ru_minflt - ru[i].ru_minflt;
+  }
+}
+
+/*
+ * phreport: print per-phase cpu usage, context switches, and page
+ * faults, averaged across writer ranks, along with the max cpu usage
+ */
+static void phreport() {
+  double avg[1 + 2 * RU_NUM];
+  double v[1 + 2 * RU_NUM];
+  double cpu[2];
+  double maxcpu;
+  int rank;
+  int sz;
+  int r;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &sz);
+  if (!rank) printf("\n==write phases:\n");
+  for (int p = 0; p < PH_NUM; p++) {
+    if (p == PH_SYNC && !g.sync) continue;
+    v[0] = phs[p].wall;
+    memcpy(v + 1, phs[p].ru, sizeof(phs[p].ru));
+    cpu[0] = phs[p].wall > 0 ? (phs[p].ru[0][RU_UTIME] +
+                                phs[p].ru[0][RU_STIME]) * 100 / phs[p].wall
+                             : 0;
+    r = MPI_Reduce(v, avg, 1 + 2 * RU_NUM, MPI_DOUBLE, MPI_SUM, 0, comm);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    r = MPI_Reduce(cpu, &maxcpu, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    if (rank) continue;
+    for (int i = 0; i < 1 + 2 * RU_NUM; i++) avg[i] /= sz;
+    for (int i = 0; i < 2; i++) {
+      double* x = avg + 1 + i * RU_NUM;
+      cpu[i] = avg[0] > 0 ? (x[RU_UTIME] + x[RU_STIME]) * 100 / avg[0] : 0;
+    }
+    printf("\t%s: %.3f s, cpu %.1f%% (max %.1f%%), usr %.3f s, sys %.3f s,"
+           " main thread cpu %.1f%%\n",
+           phases[p], avg[0], cpu[0], maxcpu, avg[1 + RU_UTIME],
+           avg[1 + RU_STIME], cpu[1]);
+    printf("\t%s: %.0f voluntary and %.0f involuntary ctx switches, "
+           "%.0f major and %.0f minor faults\n",
+           phases[p], avg[1 + RU_NVCSW], avg[1 + RU_NIVCSW],
+           avg[1 + RU_MAJFLT], avg[1 + RU_MINFLT]);
+  }
+}
+
+/*
+ * energy: get the energy of a particle at an epoch, uniformly spread
+ * over [0, 1) so that predicate selectivity follows the threshold
+ */
+static float energy(int k, int rank, int e) {
+  uint32_t h;
+
+  h = uint32_t(k) * 2654435761u ^ uint32_t(rank) * 40503u ^
+      uint32_t(e) * 2246822519u;
+  h ^= h >> 15;
+  h *= 2246822519u;
+  h ^= h >> 13;
+
+  return float(h >> 8) / float(1 << 24);
+}
+
+/*
+ * writepoch: insert epoch data into all plfsdirs. appends to different
+ * plfsdirs are interleaved key by key. with aggregation, ranks without
+ * handles forward their records to their node's writer instead.
+ */
+static void writepoch(int e) {
+  struct rusage ru[2];
+  std::string v;
+  uint64_t bytes;
+  uint64_t t0;
+  uint64_t t;
+  uint64_t pt;
+  int r;
+
+  t0 = now();
+  bytes = 0;
+  for (int d = 0; d < g.ndirs; d++) bytes -= dstats[d].bytes;
+  v.resize(g.valsz, '.');
+  if (vmsampling()) vm.epochs.push_back(now());
+  phstart(ru, &pt);
+  for (int i = 0; i < g.nkeys; i++) {
+    /* tag each value with its key and writer rank so that scans can
+     * identify records without knowing how keys are hashed */
+    if (v.size() >= 8) {
+      memcpy(&v[0], &i, 4);
+      memcpy(&v[4], &g.myrank, 4);
+    }
+    if (v.size() >= DEF_ENERGY_OFF + 4) {
+      float f = energy(i, g.myrank, e);
+      memcpy(&v[DEF_ENERGY_OFF], &f, 4);
+    }
+    if (ag.fwd) {
+      agput(i, v);
+      continue;
+    }
+    for (int d = 0; d < g.ndirs; d++) {
+      writekey(d, i, g.myrank, e, v.data(), v.size());
+    }
+  }
+  if (ag.fwd) {
+    if (ag.nbuf) agsend();
+    agsend(); /* end of epoch */
+  } else if (ag.npeers) {
+    agrecv(e);
+  }
+  phend(PH_APPEND, ru, pt);
+  for (int d = 0; d < g.ndirs; d++) bytes += dstats[d].bytes;
+
+  phstart(ru, &pt);
+  r = MPI_Barrier(comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi barrier");
+  phend(PH_BARRIER, ru, pt);
+  phstart(ru, &pt);
+  if (vmsampling()) vm.flushes.push_back(pt);
+  if (g.nodebw) nbwait(bytes);
+  for (int d = 0; d < g.ndirs && !ag.fwd; d++) {
+    t = now();
+    r = deltafs_plfsdir_epoch_flush(dirs[d], e);
+    if (r) complain("error flushing dir: %s", strerror(errno));
+    dstats[d].flushtime += now() - t;
+  }
+  if (vmsampling()) vm.flushes.push_back(now());
+  phend(PH_FLUSH, ru, pt);
+  flushlat.push_back(now() - pt);
+  if (g.sync && !ag.fwd) {
+    phstart(ru, &pt);
+    for (int d = 0; d < g.ndirs; d++) {
+      int fd = open(dirpath(d).c_str(), O_RDONLY | O_DIRECTORY);
+      if (fd == -1 || syncfs(fd) == -1)
+        complain("cannot sync %s: %s", dirpath(d).c_str(), strerror(errno));
+      close(fd);
+    }
+    phend(PH_SYNC, ru, pt);
+  }
+  if (g.tpmon) pmepoch(e);
+  if (g.drain) drkick();
+  epochlat.push_back(now() - t0);
+  if (notify) {
+    int msg[2] = {g.myrank, e};
+    r = MPI_Send(msg, 2, MPI_INT, g.nwriters + g.myrank % g.nrww, TAG_EPOCH,
+                 MPI_COMM_WORLD);
+    if (r != MPI_SUCCESS) complain("fail to send epoch notice");
+  }
+}
+
+/*
+ * writereport: print per-plfsdir and total write throughput
+ */
+static void writereport(uint64_t dura) {
+  uint64_t bytes;
+  uint64_t sums[3];
+  int rank;
+  int r;
+
+  MPI_Comm_rank(comm, &rank);
+  if (!rank) printf("\n==write results:\n");
+  bytes = 0;
+  for (int d = 0; d < g.ndirs; d++) {
+    bytes += dstats[d].bytes;
+    sums[0] = dstats[d].bytes;
+    r = MPI_Reduce(rank ? sums : MPI_IN_PLACE, sums, 1, MPI_UINT64_T, MPI_SUM,
+                   0, comm);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    r = MPI_Reduce(&dstats[d].appendtime, &sums[1], 2, MPI_UINT64_T, MPI_MAX,
+                   0, comm);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    if (!rank && g.ndirs > 1) {
+      printf("\t%s: %llu bytes, append %.3f s, flush %.3f s, %.1f MB/s\n",
+             dirpath(d).c_str(), (unsigned long long)sums[0],
+             double(sums[1]) / 1000000, double(sums[2]) / 1000000,
+             double(sums[0]) / (sums[1] + sums[2] + 1));
+    }
+  }
+  sums[0] = bytes;
+  r = MPI_Reduce(rank ? sums : MPI_IN_PLACE, sums, 1, MPI_UINT64_T, MPI_SUM, 0,
+                 comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(&dura, &sums[1], 1, MPI_UINT64_T, MPI_MAX, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (!rank) {
+    printf("\ttotal: %llu bytes, %.3f s, %.1f MB/s\n",
+           (unsigned long long)sums[0], double(sums[1]) / 1000000,
+           double(sums[0]) / (sums[1] + 1));
+  }
+  report("epoch", &epochlat, dura);
+  report("epoch flush", &flushlat, dura);
+  if (g.nodebw) {
+    r = MPI_Reduce(&nb.waittime, &sums[0], 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    r = MPI_Reduce(&nb.waittime, &sums[1], 1, MPI_UINT64_T, MPI_MAX, 0, comm);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    if (!rank)
+      printf("\tnode bandwidth wait: %.3f s total, %.3f s max rank\n",
+             double(sums[0]) / 1000000, double(sums[1]) / 1000000);
+  }
+}
+
+/*
+ * fsreport: print the num of plfsdir handles and files, the sizes of
+ * write syscalls, and the peak memory of ranks with and without handles.
+ * nd is the num of handles owned by the caller, io its wchar and syscw
+ * during write().
+ */
+static void fsreport(int nd, const uint64_t io[2]) {
+  struct dirent* ent;
+  struct rusage ru;
+  uint64_t v[4]; /* handles, wchar, syscw, forwarded batches */
+  uint64_t sums[4];
+  long mem[2]; /* peak rss (kB) as a handle owner and as a forwarder */
+  long maxmem[2];
+  long nfiles;
+  int rank;
+  int r;
+
+  getrusage(RUSAGE_SELF, &ru);
+  mem[0] = nd ? ru.ru_maxrss : 0;
+  mem[1] = nd ? 0 : ru.ru_maxrss;
+  v[0] = uint64_t(nd);
+  v[1] = io[0];
+  v[2] = io[1];
+  v[3] = ag.msgs;
+  MPI_Comm_rank(comm, &rank);
+  r = MPI_Reduce(v, sums, 4, MPI_UINT64_T, MPI_SUM, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(mem, maxmem, 2, MPI_LONG, MPI_MAX, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (rank) return;
+  nfiles = 0;
+  for (int d = 0; d < g.ndirs; d++) {
+    DIR* dir = opendir(dirpath(d).c_str());
+    if (!dir) continue;
+    while ((ent = readdir(dir)) != NULL) {
+      if (ent->d_name[0] != '.') nfiles++;
+    }
+    closedir(dir);
+  }
+  printf("\tplfsdir handles: %llu, files: %ld\n", (unsigned long long)sums[0],
+         nfiles);
+  printf("\twrite syscalls: %llu, avg %.1f KB\n", (unsigned long long)sums[2],
+         sums[2] ? double(sums[1]) / sums[2] / 1024 : 0.0);
+  if (g.aggbatch)
+    printf("\tforwarded batches: %llu\n", (unsigned long long)sums[3]);
+  printf("\tpeak rss: %ld kB with handles, %ld kB forwarding\n", maxmem[0],
+         maxmem[1]);
+}
+
+/*
+ * nodereport: break write results down by node. ranks are grouped with
+ * MPI_Comm_split_type and each node's first rank sends the node's
+ * throughput, flush time, and memory to rank 0, which flags nodes whose
+ * throughput is more than g.slowsd std devs below the median or whose
+ * flush time is more than g.slowsd std devs above it.
+ */
+static void nodereport(uint64_t dura) {
+  char host[MPI_MAX_PROCESSOR_NAME];
+  std::vector<char> hosts;
+  std::vector<double> all;
+  struct rusage ru;
+  MPI_Comm leaders;
+  MPI_Comm node;
+  double v[4]; /* bytes, max flush time, max dura, rss sum */
+  double x[4];
+  double med[2];
+  double sd[2];
+  int noderank;
+  int nnodes;
+  int rank;
+  int n;
+  int r;
+
+  getrusage(RUSAGE_SELF, &ru);
+  v[0] = v[1] = 0;
+  for (int d = 0; d < g.ndirs; d++) {
+    v[0] += dstats[d].bytes;
+    v[1] += dstats[d].flushtime;
+  }
+  v[2] = dura;
+  v[3] = ru.ru_maxrss;
+  MPI_Comm_rank(comm, &rank);
+  r = MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                          &node);
+  if (r != MPI_SUCCESS) complain("fail to split node comm");
+  MPI_Comm_rank(node, &noderank);
+  r = MPI_Reduce(&v[0], &x[0], 1, MPI_DOUBLE, MPI_SUM, 0, node);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(&v[1], &x[1], 2, MPI_DOUBLE, MPI_MAX, 0, node);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(&v[3], &x[3], 1, MPI_DOUBLE, MPI_SUM, 0, node);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  MPI_Comm_free(&node);
+  r = MPI_Comm_split(comm, noderank ? MPI_UNDEFINED : 0, rank, &leaders);
+  if (r != MPI_SUCCESS) complain("fail to split leader comm");
+  if (noderank) return;
+
+  memset(host, 0, sizeof(host));
+  MPI_Get_processor_name(host, &n);
+  MPI_Comm_size(leaders, &nnodes);
+  if (!rank) {
+    all.resize(4 * nnodes);
+    hosts.resize(sizeof(host) * nnodes);
+  }
+  r = MPI_Gather(x, 4, MPI_DOUBLE, all.data(), 4, MPI_DOUBLE, 0, leaders);
+  if (r != MPI_SUCCESS) complain("fail to do mpi gather");
+  r = MPI_Gather(host, sizeof(host), MPI_CHAR, hosts.data(), sizeof(host),
+                 MPI_CHAR, 0, leaders);
+  if (r != MPI_SUCCESS) complain("fail to do mpi gather");
+  MPI_Comm_free(&leaders);
+  if (rank) return;
+
+  for (int i = 0; i < nnodes; i++) { /* to MB/s and secs */
+    all[4 * i] /= all[4 * i + 2] + 1;
+    all[4 * i + 1] /= 1000000;
+  }
+  for (int j = 0; j < 2; j++) {
+    std::vector<double> tmp;
+    double mean = 0;
+    double var = 0;
+    for (int i = 0; i < nnodes; i++) tmp.push_back(all[4 * i + j]);
+    std::sort(tmp.begin(), tmp.end());
+    med[j] = tmp[nnodes / 2];
+    for (int i = 0; i < nnodes; i++) mean += tmp[i] / nnodes;
+    for (int i = 0; i < nnodes; i++)
+      var += (tmp[i] - mean) * (tmp[i] - mean) / nnodes;
+    sd[j] = sqrt(var);
+  }
+
+  printf("\n==per node results:\n");
+  printf("\tthroughput: median %.1f MB/s, std dev %.1f\n", med[0], sd[0]);
+  printf("\tflush time: median %.3f s, std dev %.3f\n", med[1], sd[1]);
+  n = 0;
+  for (int i = 0; i < nnodes; i++) {
+    double* p = &all[4 * i];
+    int slow = p[0] < med[0] - g.slowsd * sd[0] ||
+               p[1] > med[1] + g.slowsd * sd[1];
+    printf("\t%s: %.1f MB/s, flush %.3f s, rss %.0f kB%s\n",
+           &hosts[sizeof(host) * i], p[0], p[1], p[3], slow ? " (SLOW)" : "");
+    n += slow;
+  }
+  printf("\tslow nodes: %d of %d\n", n, nnodes);
+}
+
+/*
+ * write: insert data into plfsdirs as multiple epochs
+ */
+static void write() {
+  std::vector<deltafs_tp_t*> pools;
+  struct rusage ru[2];
+  uint64_t io[4]; /* wchar and syscw at start and end */
+  uint64_t pt;
+  uint64_t t;
+  int nd; /* num of plfsdir handles owned by the caller */
+  int r;
+  if (g.bbos) mkbbos();
+  ag.fwd = ag.npeers = 0;
+  if (g.aggbatch) agstart();
+  nd = ag.fwd ? 0 : g.ndirs;
+  /* with -J each plfsdir gets its own pool below */
+  if (nd && !g.dedicated) mkconf(g.myrank);
+  dirs = new deltafs_plfsdir_t*[g.ndirs];
+  dstats = new ds[g.ndirs];
+  memset(dstats, 0, sizeof(ds) * g.ndirs);
+  memset(phs, 0, sizeof(phs));
+  epochlat.clear();
+  flushlat.clear();
+  for (int d = 0; d < nd; d++) {
+    dirs[d] = deltafs_plfsdir_create_handle(cfstr(g.myrank, d).c_str(),
+                                            O_WRONLY);
+    deltafs_plfsdir_set_err_printer(dirs[d], printerr, NULL);
+    if (g.dedicated && g.bg) {
+      pools.push_back(mkpool(g.bg));
+      deltafs_plfsdir_set_thread_pool(dirs[d], pools.back());
+    } else if (bgp) {
+      deltafs_plfsdir_set_thread_pool(dirs[d], bgp);
+    }
+    if (env) deltafs_plfsdir_set_env(dirs[d], env);
+  }
+
+  if (g.tpmon) {
+    MPI_Comm_rank(comm, &r);
+    if (!r) printf("\n==bg pool results:\n");
+    /* only sample the pools used by this run */
+    pm.tids.clear();
+    for (size_t i = 0; i < pools.size(); i++) pmadd(pools[i]);
+    if (nd && bgp && pools.empty()) pmadd(bgp);
+    pmstart();
+  }
+  if (vmsampling()) vmstart();
+  if (g.drain) drstart();
+  if (g.nodebw) nbstart();
+  iowrite(&io[2], &io[3]);
+  t = now();
+  for (int d = 0; d < nd; d++) {
+    r = deltafs_plfsdir_open(dirs[d], dirpath(d).c_str());
+    if (r) complain("error opening dir: %s", strerror(errno));
+  }
+  for (int e = 0; e < g.nepochs; e++) {
+    if (e && g.epochgap) usleep(g.epochgap * 1000);
+    writepoch(e);
+  }
+
+  phstart(ru, &pt);
+  for (int d = 0; d < nd; d++) {
+    r = deltafs_plfsdir_finish(dirs[d]);
+    if (r) complain("error finalizing dir: %s", strerror(errno));
+    deltafs_plfsdir_free_handle(dirs[d]);
+  }
+  phend(PH_FINISH, ru, pt);
+  if (vmsampling()) vmstop(now());
+  t = now() - t;
+  wtime = t;
+  iowrite(&io[0], &io[1]);
+  io[0] -= io[2];
+  io[1] -= io[3];
+  if (g.nodebw) nbstop();
+  if (g.drain) drstop();
+  if (g.tpmon) pmstop();
+  for (size_t i = 0; i < pools.size(); i++) rmpool(pools[i]);
+  if (!quiet) {
+    writereport(t);
+    fsreport(nd, io);
+    if (g.slowsd > 0) nodereport(t);
+    phreport();
+  }
+  if (g.aggbatch) agstop();
+  delete[] dstats;
+  dstats = NULL;
+  delete[] dirs;
+  dirs = NULL;
+}
+
+/*
+ * gather: gather per-op samples from all ranks of the current comm at its
+ * rank 0. return the caller's rank in the comm.
+ */
+static int gather(std::vector<uint64_t>* v, std::vector<uint64_t>* all) {
+  std::vector<int> cnts;
+  std::vector<int> offs;
+  int rank;
+  int sz;
+  int n;
+  int r;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &sz);
+  n = int(v->size());
+  if (!rank) cnts.resize(sz);
+  r = MPI_Gather(&n, 1, MPI_INT, cnts.data(), 1, MPI_INT, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi gather");
+  if (!rank) {
+    offs.resize(sz);
+    for (int i = 0; i < sz; i++) {
+      offs[i] = i ? offs[i - 1] + cnts[i - 1] : 0;
+    }
+    all->resize(offs[sz - 1] + cnts[sz - 1]);
+  }
+  r = MPI_Gatherv(v->data(), n, MPI_UINT64_T, all->data(), cnts.data(),
+                  offs.data(), MPI_UINT64_T, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi gatherv");
+
+  return rank;
+}
+
+/*
+ * dist: gather per-op samples from all ranks of the current comm and
+ * print their distribution at its rank 0
+ */
+static void dist(const char* name, std::vector<uint64_t>* v) {
+  std::vector<uint64_t> all;
+  uint64_t sum;
+
+  if (gather(v, &all) || all.empty()) return;
+  std::sort(all.begin(), all.end());
+  sum = std::accumulate(all.begin(), all.end(), uint64_t(0));
+  printf("\t%s: avg %.1f, p50 %llu, p90 %llu, p99 %llu, max %llu\n", name,
+         double(sum) / all.size(), (unsigned long long)all[all.size() / 2],
+         (unsigned long long)all[all.size() * 9 / 10],
+         (unsigned long long)all[all.size() * 99 / 100],
+         (unsigned long long)all.back());
+}
+
+/*
+ * report: gather per-op latencies (micros) from all ranks of the current
+ * comm at its rank 0 and print their distribution along with the aggregate
+ * throughput, where dura is the time each rank took to finish all its ops.
+ */
+static void report(const char* name, std::vector<uint64_t>* lat,
+                   uint64_t dura) {
+  std::vector<uint64_t> all;
+  uint64_t maxdura;
+  uint64_t sum;
+  int rank;
+  int r;
+
+  rank = gather(lat, &all);
+  r = MPI_Reduce(&dura, &maxdura, 1, MPI_UINT64_T, MPI_MAX, 0, comm);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+
+  if (rank || all.empty()) return;
+  if (!maxdura) maxdura = 1;
+  std::sort(all.begin(), all.end());
+  sum = 0;
+  for (size_t i = 0; i < all.size(); i++) sum += all[i];
+  printf("\t%s: %d ops, %.3f s, %.1f ops/s\n", name, int(all.size()),
+         double(maxdura) / 1000000, double(all.size()) * 1000000 / maxdura);
+  printf("\t%s latency (us): avg %.1f, p50 %llu, p90 %llu, p99 %llu, "
+         "max %llu\n",
+         name, double(sum) / all.size(),
+         (unsigned long long)all[all.size() / 2],
+         (unsigned long long)all[all.size() * 9 / 10],
+         (unsigned long long)all[all.size() * 99 / 100],
+         (unsigned long long)all.back());
+}
+
+/*
+ * openrd: open all plfsdir partitions owned by the caller for reading.
+ * partitions (writer ranks) are assigned to readers round-robin.
+ */
+static void openrd() {
+  std::vector<uint64_t> t;
+  uint64_t start;
+  int r;
+
+  if (g.bbos) mkbbos();
+  rd = new deltafs_plfsdir_t*[g.nwriters / g.commsz + 1];
+  for (int w = g.myrank; w < g.nwriters; w += g.commsz) {
+    start = now();
+    mkconf(w);
+    rd[w / g.commsz] = deltafs_plfsdir_create_handle(cf.c_str(), O_RDONLY);
+    deltafs_plfsdir_set_err_printer(rd[w / g.commsz], printerr, NULL);
+    if (bgp) deltafs_plfsdir_set_thread_pool(rd[w / g.commsz], bgp);
+    if (env) deltafs_plfsdir_set_env(rd[w / g.commsz], env);
+    r = deltafs_plfsdir_open(rd[w / g.commsz], g.dirname);
+    if (r) complain("error opening dir partition %d: %s", w, strerror(errno));
+    t.push_back(now() - start);
+  }
+
+  if (!g.myrank) printf("\n==read results:\n");
+  if (!g.myrank) printf("\treaders: %d, writers: %d\n", g.commsz, g.nwriters);
+  start = std::accumulate(t.begin(), t.end(), uint64_t(0));
+  report("open", &t, start);
+}
+
+/*
+ * closerd: close all read handles owned by the caller.
+ */
+static void closerd() {
+  for (int w = g.myrank; w < g.nwriters; w += g.commsz) {
+    deltafs_plfsdir_free_handle(rd[w / g.commsz]);
+  }
+  delete[] rd;
+  rd = NULL;
+}
+
+/*
+ * dropcache: evict the cached pages of all files of the partitions
+ * owned by the caller from the os page cache.
+ */
+static void dropcache() {
+  std::vector<std::string> files;
+  int fd;
+
+  for (int w = g.myrank; w < g.nwriters; w += g.commsz) {
+    lsparts(g.dirname, w, &files);
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    fd = open(files[i].c_str(), O_RDONLY);
+    if (fd == -1) complain("cannot open %s: %s", files[i].c_str(),
+                           strerror(errno));
+    fdatasync(fd); /* dirty pages cannot be dropped */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+/*
+ * iostart: prepare for a read benchmark. on cold passes, cached pages
+ * are dropped first so that reads go to storage.
+ */
+static void iostart(uint64_t io[2]) {
+  if (cold) dropcache();
+  MPI_Barrier(MPI_COMM_WORLD);
+  ioread(&io[0], &io[1]);
+}
+
+/*
+ * ioreport: print the bytes read by all ranks since iostart(), both in
+ * total and from storage.
+ */
+static void ioreport(const char* name, uint64_t io[2]) {
+  uint64_t sums[2];
+  int r;
+
+  ioread(&sums[0], &sums[1]);
+  sums[0] -= io[0];
+  sums[1] -= io[1];
+  r = MPI_Reduce(g.myrank ? sums : MPI_IN_PLACE, sums, 2, MPI_UINT64_T,
+                 MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (!g.myrank)
+    printf("\t%s: %llu bytes read, %llu bytes from storage\n", name,
+           (unsigned long long)sums[0], (unsigned long long)sums[1]);
+}
+
+/*
+ * cache: a sharded lru cache of lookup results on the reader side.
+ * results that are found are cached as data entries, results that are
+ * not found are cached as negative entries. all shards draw from a single
+ * byte budget so that small budgets still cache something. the cache is
+ * only enabled by cquery().
+ */
+enum { C_DATA = 0, C_NEG = 1, C_TYPES = 2 };
+typedef std::list<std::pair<std::string, std::string> > clist;
+static struct cshard {
+  pthread_mutex_t mu;
+  clist lru; /* most recently used at front */
+  std::map<std::string, clist::iterator> idx;
+  size_t usage; /* bytes charged to the shard */
+  uint64_t hits[C_TYPES];
+  uint64_t misses;
+} cache[DEF_CACHE_SHARDS];
+static size_t cbudget; /* total budget of all shards (0 disables cache) */
+static size_t cusage;  /* bytes charged to all shards */
+
+static const char* ctypes[C_TYPES] = {"data", "negative"};
+
+/*
+ * cshardof: pick the shard a key goes to
+ */
+static cshard* cshardof(const std::string& key) {
+  uint32_t h = 2166136261u; /* fnv-1a */
+  for (size_t i = 0; i < key.size(); i++) {
+    h = (h ^ (unsigned char)key[i]) * 16777619u;
+  }
+  return &cache[h % DEF_CACHE_SHARDS];
+}
+
+/*
+ * cinit: (re)set the cache to a given total budget in bytes
+ */
+static void cinit(long long bytes) {
+  cbudget = size_t(bytes);
+  cusage = 0;
+  for (int i = 0; i < DEF_CACHE_SHARDS; i++) {
+    cache[i].lru.clear();
+    cache[i].idx.clear();
+    cache[i].usage = 0;
+    memset(cache[i].hits, 0, sizeof(cache[i].hits));
+    cache[i].misses = 0;
+  }
+}
+
+/*
+ * cget: look up a key in the cache. return true on hits.
+ */
+static bool cget(const std::string& key, std::string* v) {
+  cshard* s = cshardof(key);
+  std::map<std::string, clist::iterator>::iterator it;
+  bool rv = false;
+
+  if (!cbudget) return false;
+  pthread_mutex_lock(&s->mu);
+  it = s->idx.find(key);
+  if (it != s->idx.end()) {
+    s->lru.splice(s->lru.begin(), s->lru, it->second);
+    *v = it->second->second;
+    s->hits[v->empty() ? C_NEG : C_DATA]++;
+    rv = true;
+  } else {
+    s->misses++;
+  }
+  pthread_mutex_unlock(&s->mu);
+
+  return rv;
+}
+
+/*
+ * cput: insert a lookup result into the cache, evicting the least
+ * recently used entries of the key's shard to stay within the budget.
+ * the result is dropped if the shard cannot free enough space.
+ */
+static void cput(const std::string& key, const std::string& v) {
+  cshard* s = cshardof(key);
+  size_t charge = key.size() + v.size() + DEF_CACHE_OVERHEAD;
+  size_t c;
+
+  if (charge > cbudget) return;
+  pthread_mutex_lock(&s->mu);
+  if (s->idx.find(key) == s->idx.end()) {
+    while (__sync_add_and_fetch(&cusage, 0) + charge > cbudget &&
+           !s->lru.empty()) {
+      clist::iterator last = --s->lru.end();
+      c = last->first.size() + last->second.size() + DEF_CACHE_OVERHEAD;
+      s->usage -= c;
+      __sync_fetch_and_sub(&cusage, c);
+      s->idx.erase(last->first);
+      s->lru.pop_back();
+    }
+    if (__sync_add_and_fetch(&cusage, charge) <= cbudget) {
+      s->lru.push_front(std::make_pair(key, v));
+      s->idx[key] = s->lru.begin();
+      s->usage += charge;
+    } else {
+      __sync_fetch_and_sub(&cusage, charge);
+    }
+  }
+  pthread_mutex_unlock(&s->mu);
+}
+
+/*
+ * window: get the epochs [e0, e1) selected by the query window when
+ * the plfsdir has ne epochs
+ */
+static void window(int ne, int* e0, int* e1) {
+  if (g.wlast) {
+    *e0 = std::max(0, ne - g.wlast);
+    *e1 = ne;
+  } else {
+    *e0 = std::min(g.wfirst, ne);
+    *e1 = std::min(g.wend + 1, ne);
+  }
+}
+
+/*
+ * vsize: get the num of bytes a lookup is expected to return
+ */
+static size_t vsize() {
+  int e0 = 0;
+  int e1 = g.nepochs;
+
+  if (g.window) window(g.nepochs, &e0, &e1);
+  return size_t(e1 - e0) * g.valsz;
+}
+
+/*
+ * rkey: pick a random key to query. with a skew of s, a key is drawn as
+ * nkeys * u^(s + 1) for a uniform u in [0, 1), so larger skews favor
+ * lower key ids.
+ */
+static int rkey() {
+  double u;
+
+  if (!g.skew) return int(random() % g.nkeys);
+  u = double(random()) / (double(RAND_MAX) + 1);
+  return int(g.nkeys * pow(u, g.skew + 1));
+}
+
+/*
+ * lookup: read a key (all epochs, or only those in the query window) from
+ * a partition owned by the caller.
+ * return the data found (empty if not found).
+ */
+static std::string lookup(int k, int w) {
+  std::string rv;
+  char fname[20];
+  size_t sz;
+  char* data;
+
+  assert(w % g.commsz == g.myrank);
+  snprintf(fname, sizeof(fname), "f%08x-r%08x", k, w);
+  if (cget(fname, &rv)) return rv;
+  if (g.window) { /* only read the epochs in the window */
+    int e0;
+    int e1;
+    window(g.nepochs, &e0, &e1);
+    for (int e = e0; e < e1; e++) {
+      data = deltafs_plfsdir_read(rd[w / g.commsz], fname, e, &sz, NULL, NULL);
+      if (!data) complain("error reading %s: %s", fname, strerror(errno));
+      rv.append(data, sz);
+      free(data);
+    }
+    cput(fname, rv);
+    return rv;
+  }
+  data = deltafs_plfsdir_readall(rd[w / g.commsz], fname, &sz);
+  if (!data) complain("error reading %s: %s", fname, strerror(errno));
+  rv.assign(data, sz);
+  free(data);
+  cput(fname, rv);
+
+  return rv;
+}
+
+/*
+ * reps: query replies still being sent to peers. replies are sent
+ * without blocking so that two readers answering each other cannot
+ * deadlock. a list keeps each reply buffer in place until its send
+ * completes.
+ */
+static std::list<std::pair<std::string, MPI_Request> > reps;
+
+/*
+ * reap: release replies whose sends have completed. if all is set, wait
+ * for all pending replies.
+ */
+static void reap(int all) {
+  std::list<std::pair<std::string, MPI_Request> >::iterator it;
+  int flag;
+  int r;
+
+  it = reps.begin();
+  while (it != reps.end()) {
+    if (all) {
+      r = MPI_Wait(&it->second, MPI_STATUS_IGNORE);
+      flag = 1;
+    } else {
+      r = MPI_Test(&it->second, &flag, MPI_STATUS_IGNORE);
+    }
+    if (r != MPI_SUCCESS) complain("fail to send query reply");
+    if (flag) {
+      it = reps.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+/*
+ * serve: answer a query request pending from a peer reader. the
+ * request must have already been probed by the caller.
+ */
+static void serve(MPI_Status* st) {
+  int req[2]; /* key, writer rank */
+  int r;
+
+  r = MPI_Recv(req, 2, MPI_INT, st->MPI_SOURCE, TAG_REQ, MPI_COMM_WORLD,
+               MPI_STATUS_IGNORE);
+  if (r != MPI_SUCCESS) complain("fail to recv query request");
+  reps.push_back(std::make_pair(lookup(req[0], req[1]), MPI_REQUEST_NULL));
+  std::string* v = &reps.back().first;
+  r = MPI_Isend(&(*v)[0], int(v->size()), MPI_CHAR, st->MPI_SOURCE, TAG_REP,
+                MPI_COMM_WORLD, &reps.back().second);
+  if (r != MPI_SUCCESS) complain("fail to send query reply");
+  reap(0);
+}
+
+/*
+ * query: run random point queries against the plfsdir. each query is
+ * routed to the reader owning the target partition. while waiting for
+ * replies, a reader keeps answering requests from its peers.
+ */
+static void query() {
+  std::vector<uint64_t> lat;
+  std::string v;
+  MPI_Status st;
+  uint64_t io[2];
+  uint64_t start;
+  uint64_t t;
+  int nfins;
+  int wrong;
+  int owner;
+  int flag;
+  int req[2]; /* key, writer rank */
+  int sz;
+  int r;
+
+  srandom(g.myrank + 1);
+  lat.reserve(g.nqueries);
+  nfins = 0;
+  wrong = 0;
+
+  iostart(io);
+  start = now();
+  for (int i = 0; i < g.nqueries; i++) {
+    req[0] = rkey();
+    req[1] = int(random() % g.nwriters);
+    owner = req[1] % g.commsz;
+    t = now();
+    if (owner == g.myrank) {
+      v = lookup(req[0], req[1]);
+    } else {
+      r = MPI_Send(req, 2, MPI_INT, owner, TAG_REQ, MPI_COMM_WORLD);
+      if (r != MPI_SUCCESS) complain("fail to send query request");
+      for (;;) {
+        reap(0);
+        r = MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &st);
+        if (r != MPI_SUCCESS) complain("fail to probe mpi msgs");
+        if (st.MPI_TAG == TAG_REQ) {
+          serve(&st);
+        } else if (st.MPI_TAG == TAG_FIN) {
+          MPI_Recv(NULL, 0, MPI_INT, st.MPI_SOURCE, TAG_FIN, MPI_COMM_WORLD,
+                   MPI_STATUS_IGNORE);
+          nfins++;
+        } else {
+          break;
+        }
+      }
+      MPI_Get_count(&st, MPI_CHAR, &sz);
+      v.resize(sz);
+      r = MPI_Recv(&v[0], sz, MPI_CHAR, owner, TAG_REP, MPI_COMM_WORLD,
+                   MPI_STATUS_IGNORE);
+      if (r != MPI_SUCCESS) complain("fail to recv query reply");
+    }
+    lat.push_back(now() - t);
+    if (v.size() != vsize()) wrong++;
+    /* answer peers between our own queries */
+    for (;;) {
+      MPI_Iprobe(MPI_ANY_SOURCE, TAG_REQ, MPI_COMM_WORLD, &flag, &st);
+      if (!flag) break;
+      serve(&st);
+    }
+  }
+  t = now() - start;
+
+  for (int i = 0; i < g.commsz; i++) {
+    if (i != g.myrank) MPI_Send(NULL, 0, MPI_INT, i, TAG_FIN, MPI_COMM_WORLD);
+  }
+  while (nfins < g.commsz - 1) {
+    r = MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &st);
+    if (r != MPI_SUCCESS) complain("fail to probe mpi msgs");
+    if (st.MPI_TAG == TAG_REQ) {
+      serve(&st);
+    } else {
+      MPI_Recv(NULL, 0, MPI_INT, st.MPI_SOURCE, TAG_FIN, MPI_COMM_WORLD,
+               MPI_STATUS_IGNORE);
+      nfins++;
+    }
+  }
+  reap(1);
+
+  report("query", &lat, t);
+  ioreport("query", io);
+  MPI_Allreduce(MPI_IN_PLACE, &wrong, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (!g.myrank && wrong) info("%d queries returned unexpected data!", wrong);
+}
+
+/*
+ * qs: state shared by the threads of the async query engine
+ */
+static struct qs {
+  pthread_mutex_t mu;
+  std::vector<int> keys;    /* key to look up */
+  std::vector<int> ws;      /* partition (writer rank) to look up from */
+  std::vector<uint64_t> lat;
+  int next; /* next query to issue */
+  int wrong;
+} q;
+
+/*
+ * qworker: keep issuing lookups until no queries are left. each worker
+ * has at most one lookup in flight.
+ */
+static void* qworker(void* arg) {
+  std::string v;
+  uint64_t t;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&q.mu);
+    i = q.next++;
+    pthread_mutex_unlock(&q.mu);
+    if (i >= int(q.keys.size())) break;
+    t = now();
+    v = lookup(q.keys[i], q.ws[i]);
+    q.lat[i] = now() - t;
+    if (v.size() != vsize()) {
+      pthread_mutex_lock(&q.mu);
+      q.wrong++;
+      pthread_mutex_unlock(&q.mu);
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * aquery: issue random lookups against the partitions owned by the
+ * caller keeping up to depth lookups in flight. label, if not NULL,
+ * prefixes the name of the results.
+ */
+static void aquery(const char* label, int depth) {
+  std::vector<pthread_t> ths;
+  char name[50];
+  uint64_t io[2];
+  uint64_t t;
+  int nparts;
+  int r;
+
+  cinit(0); /* qd points never share cached results */
+  nparts = (g.nwriters - g.myrank + g.commsz - 1) / g.commsz;
+  srandom(g.myrank + 1);
+  q.keys.clear();
+  q.ws.clear();
+  for (int i = 0; nparts > 0 && i < g.nqueries; i++) {
+    q.keys.push_back(rkey());
+    q.ws.push_back(int(random() % nparts) * g.commsz + g.myrank);
+  }
+  q.lat.assign(q.keys.size(), 0);
+  q.next = 0;
+  q.wrong = 0;
+
+  ths.resize(depth);
+  iostart(io);
+  t = now();
+  for (int i = 0; i < depth; i++) {
+    r = pthread_create(&ths[i], NULL, qworker, NULL);
+    if (r) complain("fail to create query thread: %s", strerror(r));
+  }
+  for (int i = 0; i < depth; i++) {
+    pthread_join(ths[i], NULL);
+  }
+  t = now() - t;
+
+  if (label) {
+    snprintf(name, sizeof(name), "%s qd=%d", label, depth);
+  } else {
+    snprintf(name, sizeof(name), "qd=%d", depth);
+  }
+  report(name, &q.lat, t);
+  ioreport(name, io);
+  MPI_Allreduce(MPI_IN_PLACE, &q.wrong, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (!g.myrank && q.wrong)
+    info("%d queries returned unexpected data!", q.wrong);
+}
+
+/*
+ * bkey: a key to resolve in a batch query. epoch -1 means all epochs.
+ */
+struct bkey {
+  int w; /* partition (writer rank) */
+  int e; /* epoch */
+  int k; /* key */
+
+  bool operator==(const bkey& other) const {
+    return w == other.w && e == other.e && k == other.k;
+  }
+
+  bool operator<(const bkey& other) const {
+    if (w != other.w) return w < other.w;
+    if (e != other.e) return e < other.e;
+    return k < other.k;
+  }
+};
+
+/*
+ * loadkeys: get the batch keys owned by the caller, either from the key
+ * list or generated at random. each line of the key list is
+ * "key writer-rank [epoch]".
+ */
+static void loadkeys(std::vector<bkey>* keys) {
+  char line[100];
+  bkey bk;
+  FILE* f;
+  int nparts;
+
+  if (g.keyfile) {
+    f = fopen(g.keyfile, "r");
+    if (!f) complain("cannot open key list %s: %s", g.keyfile, strerror(errno));
+    while (fgets(line, sizeof(line), f)) {
+      bk.e = -1;
+      if (sscanf(line, "%d %d %d", &bk.k, &bk.w, &bk.e) < 2) continue;
+      if (bk.w < 0 || bk.w >= g.nwriters) continue;
+      if (bk.w % g.commsz == g.myrank) keys->push_back(bk);
+    }
+    fclose(f);
+  } else {
+    nparts = (g.nwriters - g.myrank + g.commsz - 1) / g.commsz;
+    srandom(g.myrank + 1);
+    for (int i = 0; nparts > 0 && i < g.nbatch; i++) {
+      bk.k = rkey();
+      bk.w = int(random() % nparts) * g.commsz + g.myrank;
+      bk.e = -1;
+      keys->push_back(bk);
+    }
+  }
+}
+
+/*
+ * bscan: state of a single table sweep
+ */
+struct bscan {
+  std::vector<int> ks; /* sorted keys wanted from the table */
+  int w;
+  size_t found;
+  size_t bytes;
+};
+
+/*
+ * bsaver: scan callback matching records against the wanted keys
+ */
+static int bsaver(void* arg, const char* key, size_t keylen, const char* value,
+                  size_t sz) {
+  bscan* s = static_cast<bscan*>(arg);
+  int k;
+  int w;
+
+  if (sz < 8) return 0;
+  memcpy(&k, value, 4);
+  memcpy(&w, value + 4, 4);
+  if (w == s->w && std::binary_search(s->ks.begin(), s->ks.end(), k)) {
+    s->found++;
+    s->bytes += sz;
+  }
+
+  return 0;
+}
+
+/*
+ * batch: resolve a batch of keys by sweeping each epoch table once and
+ * compare that with issuing the gets one by one.
+ */
+static void batch() {
+  std::vector<bkey> keys;
+  char fname[20];
+  bscan s;
+  uint64_t io[2];
+  uint64_t t[2];
+  uint64_t sums[3]; /* keys, values found, max time */
+  size_t found;
+  size_t sz;
+  size_t i;
+  size_t j;
+  char* data;
+  int r;
+
+  if (g.valsz < 8) complain("batch queries need values of at least 8 bytes");
+  loadkeys(&keys);
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  if (!g.myrank) printf("\n==batch results:\n");
+
+  for (int mode = 0; mode < 2; mode++) {
+    found = 0;
+    iostart(io);
+    t[0] = now();
+    if (mode == 0) { /* one get per key */
+      for (i = 0; i < keys.size(); i++) {
+        snprintf(fname, sizeof(fname), "f%08x-r%08x", keys[i].k, keys[i].w);
+        if (keys[i].e == -1) {
+          data = deltafs_plfsdir_readall(rd[keys[i].w / g.commsz], fname, &sz);
+        } else {
+          data = deltafs_plfsdir_read(rd[keys[i].w / g.commsz], fname,
+                                      keys[i].e, &sz, NULL, NULL);
+        }
+        if (!data) complain("error reading %s: %s", fname, strerror(errno));
+        found += sz / g.valsz;
+        free(data);
+      }
+    } else { /* one sweep per partition per epoch */
+      for (i = 0; i < keys.size(); i = j) {
+        s.w = keys[i].w;
+        for (j = i; j < keys.size() && keys[j].w == s.w;) j++;
+        for (int e = 0; e < g.nepochs; e++) {
+          s.ks.clear();
+          s.found = s.bytes = 0;
+          for (size_t x = i; x < j; x++) {
+            if (keys[x].e == -1 || keys[x].e == e) s.ks.push_back(keys[x].k);
+          }
+          if (s.ks.empty()) continue;
+          std::sort(s.ks.begin(), s.ks.end());
+          r = int(deltafs_plfsdir_scan(rd[s.w / g.commsz], e, bsaver, &s));
+          if (r < 0) complain("error scanning epoch %d: %s", e,
+                              strerror(errno));
+          found += s.found;
+        }
+      }
+    }
+    t[1] = now() - t[0];
+
+    sums[0] = keys.size();
+    sums[1] = found;
+    r = MPI_Reduce(g.myrank ? sums : MPI_IN_PLACE, sums, 2, MPI_UINT64_T,
+                   MPI_SUM, 0, MPI_COMM_WORLD);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    r = MPI_Reduce(&t[1], &sums[2], 1, MPI_UINT64_T, MPI_MAX, 0,
+                   MPI_COMM_WORLD);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    if (!g.myrank) {
+      if (!sums[2]) sums[2] = 1;
+      printf("\t%s: %llu keys, %llu values, %.3f s, %.1f keys/s\n",
+             mode ? "sweep" : "gets", (unsigned long long)sums[0],
+             (unsigned long long)sums[1], double(sums[2]) / 1000000,
+             double(sums[0]) * 1000000 / sums[2]);
+    }
+    ioreport(mode ? "sweep" : "gets", io);
+  }
+}
+
+/*
+ * cquery: run a repeated query workload over a small set of hot keys
+ * owned by the caller with a given cache size. g.absent percent of the
+ * hot keys were never written so that negative entries are exercised.
+ */
+static void cquery(long long bytes) {
+  std::vector<uint64_t> lat;
+  std::vector<int> hot;
+  uint64_t cnts[C_TYPES + 1]; /* hits per type, misses */
+  uint64_t io[2];
+  uint64_t t;
+  uint64_t start;
+  char name[50];
+  int nparts;
+  int k;
+  int i;
+  int r;
+
+  nparts = (g.nwriters - g.myrank + g.commsz - 1) / g.commsz;
+  srandom(g.myrank + 1);
+  for (i = 0; nparts > 0 && i < g.hotkeys; i++) {
+    k = rkey();
+    if (random() % 100 < g.absent) k += g.nkeys; /* never written */
+    hot.push_back(k);
+    hot.push_back(int(random() % nparts) * g.commsz + g.myrank);
+  }
+  cinit(bytes);
+  lat.reserve(g.nqueries);
+
+  iostart(io);
+  start = now();
+  for (i = 0; !hot.empty() && i < g.nqueries; i++) {
+    r = int(random() % (hot.size() / 2)) * 2;
+    t = now();
+    lookup(hot[r], hot[r + 1]);
+    lat.push_back(now() - t);
+  }
+  t = now() - start;
+
+  memset(cnts, 0, sizeof(cnts));
+  for (i = 0; i < DEF_CACHE_SHARDS; i++) {
+    for (int j = 0; j < C_TYPES; j++) cnts[j] += cache[i].hits[j];
+    cnts[C_TYPES] += cache[i].misses;
+  }
+  snprintf(name, sizeof(name), "cache=%lld", bytes);
+  report(name, &lat, t);
+  r = MPI_Reduce(g.myrank ? cnts : MPI_IN_PLACE, cnts, C_TYPES + 1,
+                 MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (!g.myrank) {
+    printf("\t%s hits:", name);
+    for (int j = 0; j < C_TYPES; j++) {
+      printf(" %s %llu,", ctypes[j], (unsigned long long)cnts[j]);
+    }
+    printf(" misses %llu\n", (unsigned long long)cnts[C_TYPES]);
+  }
+  ioreport(name, io);
+  cinit(0);
+}
+
+/*
+ * pl: state shared by the threads of the index/filter preloader. index
+ * logs, which hold all index and filter blocks of a partition, are
+ * mapped, faulted in, and locked in memory so that queries no longer
+ * go to storage for them.
+ */
+static struct pl {
+  pthread_mutex_t mu;
+  std::vector<std::string> files; /* index logs to load */
+  std::vector<std::pair<void*, size_t> > maps;
+  size_t next; /* next file to load */
+  size_t bytes;
+} p;
+
+/*
+ * plworker: load index logs until none is left
+ */
+static void* plworker(void* arg) {
+  struct stat st;
+  void* m;
+  size_t i;
+  int fd;
+
+  for (;;) {
+    pthread_mutex_lock(&p.mu);
+    i = p.next++;
+    pthread_mutex_unlock(&p.mu);
+    if (i >= p.files.size()) break;
+    fd = open(p.files[i].c_str(), O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1)
+      complain("cannot open %s: %s", p.files[i].c_str(), strerror(errno));
+    if (st.st_size) {
+      m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+      if (m == MAP_FAILED)
+        complain("cannot map %s: %s", p.files[i].c_str(), strerror(errno));
+      mlock(m, st.st_size); /* best effort */
+      pthread_mutex_lock(&p.mu);
+      p.maps.push_back(std::make_pair(m, size_t(st.st_size)));
+      p.bytes += st.st_size;
+      pthread_mutex_unlock(&p.mu);
+    }
+    close(fd);
+  }
+
+  return NULL;
+}
+
+/*
+ * preload: load the index logs of all partitions owned by the caller in
+ * parallel. use one loader per bg thread (-j), or a single one.
+ */
+static void preload() {
+  std::vector<std::string> files;
+  std::vector<pthread_t> ths;
+  uint64_t sums[2]; /* bytes loaded, max time */
+  uint64_t t;
+  int r;
+
+  for (int w = g.myrank; w < g.nwriters; w += g.commsz) {
+    lsparts(g.dirname, w, &files);
+  }
+  p.files.clear();
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i].find(".idx") != std::string::npos) p.files.push_back(files[i]);
+  }
+  p.next = 0;
+  p.bytes = 0;
+
+  ths.resize(g.bg ? g.bg : 1);
+  MPI_Barrier(MPI_COMM_WORLD);
+  t = now();
+  for (size_t i = 0; i < ths.size(); i++) {
+    r = pthread_create(&ths[i], NULL, plworker, NULL);
+    if (r) complain("fail to create preload thread: %s", strerror(r));
+  }
+  for (size_t i = 0; i < ths.size(); i++) {
+    pthread_join(ths[i], NULL);
+  }
+  t = now() - t;
+
+  sums[0] = p.bytes;
+  MPI_Reduce(g.myrank ? sums : MPI_IN_PLACE, sums, 1, MPI_UINT64_T, MPI_SUM,
+             0, MPI_COMM_WORLD);
+  MPI_Reduce(&t, &sums[1], 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (!g.myrank)
+    printf("\tpreload: %.3f s, %llu bytes in memory\n",
+           double(sums[1]) / 1000000, (unsigned long long)sums[0]);
+}
+
+/*
+ * unload: release all preloaded index logs
+ */
+static void unload() {
+  for (size_t i = 0; i < p.maps.size(); i++) {
+    munlock(p.maps[i].first, p.maps[i].second);
+    munmap(p.maps[i].first, p.maps[i].second);
+  }
+  p.maps.clear();
+}
+
+/*
+ * plquery: compare query latency with and without preloading, each
+ * with a cold and a warm os page cache.
+ */
+static void plquery() {
+  static const char* labels[2][2] = {{"cold lazy", "cold preload"},
+                                     {"warm lazy", "warm preload"}};
+
+  if (!g.myrank) printf("\n==preload results:\n");
+  cinit(0);
+  pthread_mutex_init(&q.mu, NULL);
+  pthread_mutex_init(&p.mu, NULL);
+  for (int warm = 0; warm < 2; warm++) {
+    for (int pre = 0; pre < 2; pre++) {
+      if (!warm) dropcache();
+      if (pre) preload();
+      aquery(labels[warm][pre], 1);
+      unload();
+    }
+  }
+  pthread_mutex_destroy(&p.mu);
+  pthread_mutex_destroy(&q.mu);
+}
+
+/*
+ * probe: read a file from each epoch in [e0, e1) of a partition, one
+ * epoch at a time. x gets the storage reads, syscall bytes read, and
+ * tables probed, along with the time (micros) it took.
+ */
+static void probe(deltafs_plfsdir_t* h, const char* fname, int e0, int e1,
+                  uint64_t x[4]) {
+  static uint64_t self = ~uint64_t(0); /* bytes read by ioread() itself */
+  uint64_t rchar[2];
+  uint64_t rbytes;
+  size_t tseeks;
+  size_t seeks;
+  size_t sz;
+  char* data;
+
+  if (self == ~uint64_t(0)) {
+    ioread(&rchar[0], &rbytes);
+    ioread(&rchar[1], &rbytes);
+    self = rchar[1] - rchar[0];
+  }
+  x[0] = x[2] = 0;
+  ioread(&rchar[0], &rbytes);
+  x[3] = now();
+  for (int e = e0; e < e1; e++) {
+    tseeks = seeks = 0;
+    data = deltafs_plfsdir_read(h, fname, e, &sz, &tseeks, &seeks);
+    if (!data) complain("error reading %s: %s", fname, strerror(errno));
+    free(data);
+    x[0] += seeks;
+    x[2] += tseeks;
+  }
+  x[3] = now() - x[3];
+  ioread(&rchar[1], &rbytes);
+  x[1] = rchar[1] - rchar[0] - std::min(self, rchar[1] - rchar[0]);
+}
+
+/*
+ * wquery: compare lookups restricted to the query window with lookups
+ * over all epochs. both are repeated over the first 1, 2, 4, ... epochs
+ * to show how their costs scale with the num of epochs. each rank
+ * queries the partitions it owns directly.
+ */
+static void wquery() {
+  static const char* what[4] = {"storage reads", "bytes", "tables",
+                                "latency (us)"};
+  std::vector<uint64_t> v[2][4]; /* all epochs, window x costs */
+  std::vector<uint64_t> all;
+  char fname[20];
+  uint64_t x[4];
+  double avg[2][4];
+  uint64_t p99[2];
+  int nparts;
+  int e0;
+  int e1;
+  int w;
+
+  if (!g.nepochs) return;
+  if (!g.myrank) {
+    printf("\n==windowed query results:\n");
+    printf("\twindow: %s\n", g.window);
+  }
+  nparts = (g.nwriters - g.myrank + g.commsz - 1) / g.commsz;
+  srandom(g.myrank + 1);
+  for (int ne = 1;; ne = std::min(ne * 2, g.nepochs)) {
+    if (cold) dropcache(); /* each round starts cold */
+    window(ne, &e0, &e1);
+    for (int i = 0; nparts && i < g.nqueries; i++) {
+      w = int(random() % nparts) * g.commsz + g.myrank;
+      snprintf(fname, sizeof(fname), "f%08x-r%08x", rkey(), w);
+      probe(rd[w / g.commsz], fname, 0, ne, x);
+      for (int j = 0; j < 4; j++) v[0][j].push_back(x[j]);
+      probe(rd[w / g.commsz], fname, e0, e1, x);
+      for (int j = 0; j < 4; j++) v[1][j].push_back(x[j]);
+    }
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 4; j++) {
+        all.clear();
+        avg[i][j] = 0;
+        p99[i] = 0;
+        if (!gather(&v[i][j], &all) && !all.empty()) {
+          avg[i][j] = double(std::accumulate(all.begin(), all.end(),
+                                             uint64_t(0))) / all.size();
+          std::sort(all.begin(), all.end());
+          p99[i] = all[all.size() * 99 / 100]; /* latency is the last */
+        }
+        v[i][j].clear();
+      }
+    }
+    if (!g.myrank) {
+      for (int i = 0; i < 2; i++) {
+        printf("\t%d epochs, %s [%d, %d): avg %.1f %s, %.1f %s, %.1f %s, "
+               "%.1f %s (p99 %llu)\n",
+               ne, i ? "window" : "all epochs", i ? e0 : 0, i ? e1 : ne,
+               avg[i][0], what[0], avg[i][1], what[1], avg[i][2], what[2],
+               avg[i][3], what[3], (unsigned long long)p99[i]);
+      }
+    }
+    if (ne == g.nepochs) break;
+  }
+}
+
+/*
+ * ampquery: measure the read amplification of each query. every rank
+ * queries the partitions it owns directly (without mpi) so that the
+ * syscall bytes it reads can be charged to a single query. three kinds of
+ * queries are issued: hits (a written key at one epoch), misses (a key
+ * never written) and trajectories (a written key at every epoch, read
+ * epoch by epoch so that each epoch's probes are counted). trajectories
+ * are repeated over the first 1, 2, 4, ... epochs to show how costs grow
+ * with the num of epochs.
+ */
+static void ampquery() {
+  static const char* kinds[3] = {"hit", "miss", "trajectory"};
+  static const char* what[3] = {"storage reads", "bytes read",
+                                "tables probed"};
+  std::vector<uint64_t> v[3][3]; /* query kind x reads, bytes, tables */
+  std::vector<uint64_t> xs[3];   /* trajectory costs for a num of epochs */
+  uint64_t x[4];
+  char fname[20];
+  char name[100];
+  int nparts;
+  int w;
+  int k;
+  int e;
+
+  if (!g.nepochs) return;
+  if (!g.myrank) {
+    printf("\n==read amplification:\n");
+    printf("\tepochs: %d, log rotation: %d\n", g.nepochs, g.logrotation);
+  }
+  nparts = (g.nwriters - g.myrank + g.commsz - 1) / g.commsz;
+  srandom(g.myrank + 1);
+  for (int ne = 1;; ne = std::min(ne * 2, g.nepochs)) {
+    for (int kind = 0; kind < 3; kind++) {
+      if (kind != 2 && ne != g.nepochs) continue; /* hits and misses once */
+      if (cold) dropcache(); /* each kind of query starts cold */
+      for (int i = 0; nparts && i < g.nqueries; i++) {
+        w = int(random() % nparts) * g.commsz + g.myrank;
+        k = rkey();
+        if (kind == 1) k += g.nkeys; /* never written */
+        snprintf(fname, sizeof(fname), "f%08x-r%08x", k, w);
+        e = int(random() % g.nepochs);
+        if (kind == 2) {
+          probe(rd[w / g.commsz], fname, 0, ne, x);
+        } else {
+          probe(rd[w / g.commsz], fname, e, e + 1, x);
+        }
+        for (int j = 0; j < 3; j++) {
+          if (ne == g.nepochs) v[kind][j].push_back(x[j]);
+          if (kind == 2) xs[j].push_back(x[j]);
+        }
+      }
+    }
+    if (ne != g.nepochs) {
+      for (int j = 0; j < 3; j++) {
+        snprintf(name, sizeof(name), "trajectory over %d epochs, %s", ne,
+                 what[j]);
+        dist(name, &xs[j]);
+      }
+    }
+    for (int j = 0; j < 3; j++) xs[j].clear();
+    if (ne == g.nepochs) break;
+  }
+  for (int kind = 0; kind < 3; kind++) {
+    for (int j = 0; j < 3; j++) {
+      snprintf(name, sizeof(name), "%s, %s", kinds[kind], what[j]);
+      dist(name, &v[kind][j]);
+    }
+  }
+}
+
+/*
+ * predicate scan kernels. each finds the records in a column of energies
+ * with energy > thres, writes their indices to out, and returns the num
+ * of matches. the simd kernels leave the tail to the scalar loop.
+ */
+static size_t fscalar(const float* v, size_t i, size_t n, float thres,
+                      uint32_t* out) {
+  size_t m = 0;
+  for (; i < n; i++) {
+    out[m] = uint32_t(i);
+    m += v[i] > thres; /* branch-free */
+  }
+  return m;
+}
+
+#if defined(__x86_64__)
+static size_t fsse(const float* v, size_t n, float thres, uint32_t* out) {
+  const __m128 t = _mm_set1_ps(thres);
+  size_t m = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(v + i), t));
+    while (mask) {
+      out[m++] = uint32_t(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return m + fscalar(v, i, n, thres, out + m);
+}
+
+__attribute__((target("avx2"))) static size_t favx2(const float* v, size_t n,
+                                                     float thres,
+                                                     uint32_t* out) {
+  const __m256 t = _mm256_set1_ps(thres);
+  size_t m = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(v + i);
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(x, t, _CMP_GT_OQ));
+    while (mask) {
+      out[m++] = uint32_t(i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  return m + fscalar(v, i, n, thres, out + m);
+}
+#endif
+
+/*
+ * fsimd: run the widest simd kernel the cpu supports
+ */
+static size_t fsimd(const float* v, size_t n, float thres, uint32_t* out) {
+#if defined(__x86_64__)
+  static const int avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) return favx2(v, n, thres, out);
+  return fsse(v, n, thres, out);
+#else
+  return fscalar(v, 0, n, thres, out);
+#endif
+}
+
+/*
+ * ps: state of a predicate scan thread. scans append the energy field and
+ * the key of each record to a column, which the kernels then filter.
+ */
+struct ps {
+  pthread_t th;
+  int tid;
+  std::vector<deltafs_plfsdir_t*> hs; /* one read handle per partition */
+  std::vector<float> col;
+  std::vector<std::pair<int, int> > keys; /* key and writer rank */
+  std::vector<uint32_t> out;
+  std::vector<int> hits; /* epoch, key and writer rank of each match */
+  uint64_t records;
+  uint64_t bytes;      /* key and value bytes scanned */
+  uint64_t t[3];       /* micros spent in scans, scalar and simd kernels */
+  uint64_t matches[2]; /* found by the scalar and the simd kernels */
+};
+
+/*
+ * psaver: scan callback adding a record to a scan thread's column
+ */
+static int psaver(void* arg, const char* key, size_t keylen, const char* value,
+                  size_t sz) {
+  ps* s = static_cast<ps*>(arg);
+  float f;
+  int k;
+  int r;
+
+  s->records++;
+  s->bytes += keylen + sz;
+  if (sz < DEF_ENERGY_OFF + 4) return 0;
+  memcpy(&k, value, 4);
+  memcpy(&r, value + 4, 4);
+  memcpy(&f, value + DEF_ENERGY_OFF, 4);
+  s->keys.push_back(std::make_pair(k, r));
+  s->col.push_back(f);
+  return 0;
+}
+
+/*
+ * psloop: scan epochs tid, tid + pthreads, ... of every partition owned
+ * by the caller and filter each epoch with both kernels
+ */
+static void* psloop(void* arg) {
+  ps* s = static_cast<ps*>(arg);
+  uint64_t t;
+  size_t n;
+  size_t m;
+
+  for (size_t p = 0; p < s->hs.size(); p++) {
+    for (int e = s->tid; e < g.nepochs; e += g.pthreads) {
+      s->col.clear();
+      s->keys.clear();
+      t = now();
+      if (deltafs_plfsdir_scan(s->hs[p], e, psaver, s) < 0)
+        complain("error scanning epoch %d: %s", e, strerror(errno));
+      s->t[0] += now() - t;
+      n = s->col.size();
+      s->out.resize(n);
+      /* untimed warm-up so that both kernels see a warm column */
+      fscalar(s->col.data(), 0, n, g.pthres, s->out.data());
+      fsimd(s->col.data(), n, g.pthres, s->out.data());
+      t = now();
+      m = fscalar(s->col.data(), 0, n, g.pthres, s->out.data());
+      s->t[1] += now() - t;
+      s->matches[0] += m;
+      t = now();
+      m = fsimd(s->col.data(), n, g.pthres, s->out.data());
+      s->t[2] += now() - t;
+      s->matches[1] += m;
+      for (size_t i = 0; i < m; i++) {
+        s->hits.push_back(e);
+        s->hits.push_back(s->keys[s->out[i]].first);
+        s->hits.push_back(s->keys[s->out[i]].second);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * pshits: write the matches found by the caller to plfsdir.pscan.<rank>,
+ * one "epoch key writer-rank" per line, and print the num of matches of
+ * each rank along with a few samples
+ */
+static void pshits(const std::vector<ps>& ss) {
+  std::vector<int> all;
+  int x[1 + 3 * DEF_PSCAN_SAMPLE]; /* num of matches, samples */
+  char tmp[20];
+  std::string path;
+  FILE* f;
+  int n;
+  int r;
+
+  snprintf(tmp, sizeof(tmp), ".pscan.%d", g.myrank);
+  path = std::string(g.dirname) + tmp;
+  f = fopen(path.c_str(), "w");
+  if (!f) complain("cannot open %s: %s", path.c_str(), strerror(errno));
+  memset(x, -1, sizeof(x));
+  x[0] = n = 0;
+  for (size_t i = 0; i < ss.size(); i++) {
+    const std::vector<int>& h = ss[i].hits;
+    for (size_t j = 0; j + 2 < h.size(); j += 3) {
+      fprintf(f, "%d %d %d\n", h[j], h[j + 1], h[j + 2]);
+      if (n < DEF_PSCAN_SAMPLE) memcpy(&x[1 + 3 * n++], &h[j], 3 * sizeof(int));
+      x[0]++;
+    }
+  }
+  if (fclose(f) != 0) complain("cannot write %s: %s", path.c_str(),
+                               strerror(errno));
+
+  if (!g.myrank) all.resize(size_t(g.commsz) * (1 + 3 * DEF_PSCAN_SAMPLE));
+  r = MPI_Gather(x, 1 + 3 * DEF_PSCAN_SAMPLE, MPI_INT, all.data(),
+                 1 + 3 * DEF_PSCAN_SAMPLE, MPI_INT, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi gather");
+  if (g.myrank) return;
+  printf("\tmatches written to %s.pscan.<rank>\n", g.dirname);
+  for (int i = 0; i < g.commsz; i++) {
+    int* p = &all[size_t(i) * (1 + 3 * DEF_PSCAN_SAMPLE)];
+    printf("\trank %d: %d matches", i, p[0]);
+    for (int j = 0; j < std::min(p[0], DEF_PSCAN_SAMPLE); j++) {
+      printf("%s key %d of rank %d at epoch %d", j ? "," : ", e.g.",
+             p[2 + 3 * j], p[3 + 3 * j], p[1 + 3 * j]);
+    }
+    printf("\n");
+  }
+}
+
+/*
+ * pscan: find the records whose energy is above a threshold. each rank
+ * scans the partitions it owns, with epochs spread over g.pthreads
+ * threads that each use their own read handles. only matching keys are
+ * kept, and pshits() writes them out. the scalar and simd kernels run
+ * over the same columns so that their costs can be compared.
+ */
+static void pscan() {
+  std::vector<ps> ss(g.pthreads);
+  uint64_t x[6]; /* records, bytes, hits, scalar matches, simd, wall time */
+  uint64_t sums[6];
+  uint64_t kt[3]; /* max micros in scans, scalar and simd kernels */
+  uint64_t maxkt[3];
+  const char* simd;
+  int r;
+
+  if (g.valsz < DEF_ENERGY_OFF + 4)
+    complain("predicate scans need values of at least %d bytes",
+             DEF_ENERGY_OFF + 4);
+  for (int i = 0; i < g.pthreads; i++) {
+    ss[i].tid = i;
+    ss[i].records = ss[i].bytes = 0;
+    memset(ss[i].t, 0, sizeof(ss[i].t));
+    memset(ss[i].matches, 0, sizeof(ss[i].matches));
+    for (int w = g.myrank; w < g.nwriters; w += g.commsz) {
+      ss[i].hs.push_back(tryopen(w));
+      if (!ss[i].hs.back()) complain("cannot open partition %d", w);
+    }
+  }
+  if (cold) dropcache();
+  MPI_Barrier(MPI_COMM_WORLD);
+  x[5] = now();
+  for (int i = 0; i < g.pthreads; i++) {
+    r = pthread_create(&ss[i].th, NULL, psloop, &ss[i]);
+    if (r) complain("fail to create scan thread: %s", strerror(r));
+  }
+  memset(x, 0, sizeof(uint64_t) * 5);
+  memset(kt, 0, sizeof(kt));
+  for (int i = 0; i < g.pthreads; i++) {
+    pthread_join(ss[i].th, NULL);
+    for (size_t p = 0; p < ss[i].hs.size(); p++) {
+      deltafs_plfsdir_free_handle(ss[i].hs[p]);
+    }
+    x[0] += ss[i].records;
+    x[1] += ss[i].bytes;
+    x[2] += ss[i].hits.size() / 3;
+    x[3] += ss[i].matches[0];
+    x[4] += ss[i].matches[1];
+    for (int j = 0; j < 3; j++) kt[j] = std::max(kt[j], ss[i].t[j]);
+  }
+  x[5] = now() - x[5];
+  if (x[3] != x[4]) complain("scalar and simd kernels disagree");
+
+  r = MPI_Reduce(x, sums, 5, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(&x[5], &sums[5], 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(kt, maxkt, 3, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (g.myrank) {
+    pshits(ss);
+    return;
+  }
+#if defined(__x86_64__)
+  simd = __builtin_cpu_supports("avx2") ? "avx2" : "sse";
+#else
+  simd = "none (scalar)";
+#endif
+  printf("\n==predicate scan results:\n");
+  printf("\tpredicate: energy > %g, %d threads per rank, simd: %s\n",
+         g.pthres, g.pthreads, simd);
+  printf("\tscanned: %llu records, %llu bytes, %llu matching keys "
+         "(%.3f%% selectivity)\n",
+         (unsigned long long)sums[0], (unsigned long long)sums[1],
+         (unsigned long long)sums[2],
+         sums[0] ? double(sums[2]) * 100 / sums[0] : 0.0);
+  printf("\tscan + filter: %.3f s, %.3f GB/s\n", double(sums[5]) / 1000000,
+         double(sums[1]) / (sums[5] + 1) / 1000);
+  printf("\tscalar kernel: %.3f ms (max thread), %.3f GB/s of values\n",
+         double(maxkt[1]) / 1000,
+         double(sums[0]) * 4 / (maxkt[1] * g.commsz + 1) / 1000);
+  printf("\tsimd kernel: %.3f ms (max thread), %.3f GB/s of values, "
+         "%.1fx scalar\n",
+         double(maxkt[2]) / 1000,
+         double(sums[0]) * 4 / (maxkt[2] * g.commsz + 1) / 1000,
+         maxkt[2] ? double(maxkt[1]) / maxkt[2] : 0.0);
+  pshits(ss);
+}
+
+/*
+ * runreads: run all configured read benchmarks once. label, if not
+ * NULL, names the page cache state the pass runs with.
+ */
+static void runreads(const char* label) {
+  if (!g.myrank && label) printf("\n==%s reads:\n", label);
+  if (g.nqueries) query();
+  if (g.qdepth) {
+    pthread_mutex_init(&q.mu, NULL);
+    for (int d = 1; d < g.qdepth; d *= 2) aquery(NULL, d);
+    aquery(NULL, g.qdepth);
+    pthread_mutex_destroy(&q.mu);
+  }
+  if (g.nbatch || g.keyfile) batch();
+  if (g.amp && g.nqueries) ampquery();
+  if (g.window && g.nqueries) wquery();
+  if (g.pscan) pscan();
+  if (g.hotkeys && g.nqueries) {
+    if (!g.myrank) printf("\n==cache results:\n");
+    cquery(0);
+    for (long long c = g.cachesz / 8; c && c < g.cachesz; c *= 2) cquery(c);
+    if (g.cachesz) cquery(g.cachesz);
+  }
+}
+
+/*
+ * read: open plfsdir partitions and serve distributed queries
+ */
+static void read() {
+  openrd();
+  for (int i = 0; i < DEF_CACHE_SHARDS; i++) {
+    pthread_mutex_init(&cache[i].mu, NULL);
+  }
+  cinit(0); /* only cquery() runs with the cache */
+  if (g.coldwarm) {
+    cold = 1;
+    runreads("cold");
+    cold = 0;
+    runreads("warm");
+  } else {
+    runreads(NULL);
+  }
+  if (g.preload && g.nqueries) plquery();
+  closerd();
+}
+
+/*
+ * tryopen: open a partition for reading. return NULL on errors.
+ */
+static deltafs_plfsdir_t* tryopen(int w) {
+  deltafs_plfsdir_t* h;
+
+  mkconf(w);
+  h = deltafs_plfsdir_create_handle(cf.c_str(), O_RDONLY);
+  if (!h) return NULL;
+  if (bgp) deltafs_plfsdir_set_thread_pool(h, bgp);
+  if (env) deltafs_plfsdir_set_env(h, env);
+  if (deltafs_plfsdir_open(h, g.dirname) != 0) {
+    deltafs_plfsdir_free_handle(h);
+    return NULL;
+  }
+
+  return h;
+}
+
+/*
+ * rwwread: wait for flushed epochs announced by writers and query them
+ * while later epochs are still being written. each reader serves the
+ * writers w with w % nrww equal to its reader index.
+ */
+static void rwwread(std::vector<uint64_t>* lat, std::vector<uint64_t>* lag,
+                    int* nlost) {
+  deltafs_plfsdir_t* h;
+  char fname[20];
+  uint64_t t;
+  size_t sz;
+  char* data;
+  int msg[2]; /* writer rank, epoch */
+  int nmsgs;
+  int me;
+  int e;
+  int r;
+
+  me = g.myrank - g.nwriters;
+  nmsgs = 0;
+  for (int w = me; w < g.nwriters; w += g.nrww) nmsgs += g.nepochs;
+  srandom(g.myrank + 1);
+  for (; nmsgs > 0; nmsgs--) {
+    r = MPI_Recv(msg, 2, MPI_INT, MPI_ANY_SOURCE, TAG_EPOCH, MPI_COMM_WORLD,
+                 MPI_STATUS_IGNORE);
+    if (r != MPI_SUCCESS) complain("fail to recv epoch notice");
+    t = now();
+    data = NULL;
+    sz = 0;
+    snprintf(fname, sizeof(fname), "f%08x-r%08x", 0, msg[0]);
+    for (;;) {
+      h = tryopen(msg[0]);
+      if (h) {
+        data = deltafs_plfsdir_read(h, fname, msg[1], &sz, NULL, NULL);
+        if (data && sz == size_t(g.valsz)) break;
+        free(data);
+        data = NULL;
+        deltafs_plfsdir_free_handle(h);
+        h = NULL;
+      }
+      if (now() - t > DEF_QUERYABLE_WAIT) break;
+      usleep(1000);
+    }
+    if (!h) {
+      (*nlost)++;
+      continue;
+    }
+    lag->push_back(now() - t);
+    free(data);
+    for (int i = 0; i < g.nqueries; i++) {
+      snprintf(fname, sizeof(fname), "f%08x-r%08x", rkey(), msg[0]);
+      e = int(random() % (msg[1] + 1));
+      t = now();
+      data = deltafs_plfsdir_read(h, fname, e, &sz, NULL, NULL);
+      if (!data) complain("error reading %s: %s", fname, strerror(errno));
+      lat->push_back(now() - t);
+      free(data);
+    }
+    deltafs_plfsdir_free_handle(h);
+  }
+}
+
+/*
+ * rww: write the plfsdir from the first commsz - nrww ranks while the
+ * remaining ranks query epochs as soon as they are flushed. to measure
+ * the ingest slowdown caused by readers, writers first write a copy of
+ * the plfsdir (at plfsdir.base) with readers idle.
+ */
+static void rww() {
+  std::vector<uint64_t> lat;
+  std::vector<uint64_t> lag;
+  std::string base;
+  const char* dirname;
+  uint64_t t[2]; /* ingest time without and with readers */
+  uint64_t tr;   /* time readers take */
+  int isreader;
+  int nlost;
+  int r;
+
+  g.nwriters = g.commsz - g.nrww;
+  isreader = g.myrank >= g.nwriters;
+  r = MPI_Comm_split(MPI_COMM_WORLD, isreader, g.myrank, &comm);
+  if (r != MPI_SUCCESS) complain("fail to split mpi comm");
+  dirname = g.dirname;
+  base = std::string(g.dirname) + ".base";
+  t[0] = t[1] = tr = 0;
+  nlost = 0;
+
+  if (!isreader) {
+    g.dirname = base.c_str();
+    t[0] = now();
+    write();
+    t[0] = now() - t[0];
+    g.dirname = dirname;
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (!isreader) {
+    notify = 1;
+    t[1] = now();
+    write();
+    t[1] = now() - t[1];
+    notify = 0;
+  } else {
+    tr = now();
+    rwwread(&lat, &lag, &nlost);
+    tr = now() - tr;
+  }
+
+  r = MPI_Reduce(g.myrank ? t : MPI_IN_PLACE, t, 2, MPI_UINT64_T, MPI_MAX, 0,
+                 MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  r = MPI_Reduce(g.myrank ? &nlost : MPI_IN_PLACE, &nlost, 1, MPI_INT,
+                 MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  MPI_Comm_free(&comm);
+  comm = MPI_COMM_WORLD;
+  if (!g.myrank) {
+    printf("\n==read while write results:\n");
+    printf("\twriters: %d, readers: %d\n", g.nwriters, g.nrww);
+    printf("\tingest: %.3f s alone, %.3f s with readers (%.1f%% slowdown)\n",
+           double(t[0]) / 1000000, double(t[1]) / 1000000,
+           t[0] ? (double(t[1]) / t[0] - 1) * 100 : 0.0);
+  }
+  report("queryable after flush", &lag, tr);
+  if (!g.myrank && nlost)
+    info("%d flushed epochs not queryable within %d us", nlost,
+         DEF_QUERYABLE_WAIT);
+  report("query under ingest", &lat, tr);
+}
+
+/*
+ * tn: a tenant group writing its own plfsdir with its own config
+ */
+struct tn {
+  int nranks;
+  int iosz;
+  int valsz;
+  int epochgap;
+};
+
+/*
+ * parsetenants: parse the tenant spec. return the num of tenants or -1
+ * if the spec is bad.
+ */
+static int parsetenants(const char* spec, std::vector<tn>* ts) {
+  const char* p;
+  int nranks;
+  tn t;
+  int n;
+
+  nranks = 0;
+  for (p = spec; *p; p += n) {
+    if (p != spec && *p++ != ',') return -1;
+    if (sscanf(p, "%d:%d:%d:%d%n", &t.nranks, &t.iosz, &t.valsz, &t.epochgap,
+               &n) != 4)
+      return -1;
+    if (t.nranks <= 0 || t.iosz <= 0 || t.valsz <= 0 || t.epochgap < 0)
+      return -1;
+    nranks += t.nranks;
+    ts->push_back(t);
+  }
+  if (nranks != g.commsz) return -1;
+  return int(ts->size());
+}
+
+/*
+ * tenants: split MPI_COMM_WORLD into tenant groups that each write their
+ * own plfsdir (plfsdir.t0, plfsdir.t1, ...). each group first writes
+ * alone, one group at a time, then all groups write at the same time
+ * (to plfsdir.t0.shared, ...) so that the slowdown caused by the other
+ * groups can be measured.
+ */
+static void tenants() {
+  std::vector<uint64_t> all;
+  std::vector<tn> ts;
+  std::string dir[2];
+  const char* dirname;
+  uint64_t v[3]; /* bytes, time alone, time shared */
+  char tmp[20];
+  int me;
+  int n;
+  int r;
+
+  n = parsetenants(g.tenants, &ts);
+  if (n <= 0) complain("bad tenant spec: %s", g.tenants);
+  me = 0;
+  for (int sum = ts[0].nranks; g.myrank >= sum; sum += ts[me].nranks) me++;
+  r = MPI_Comm_split(MPI_COMM_WORLD, me, g.myrank, &comm);
+  if (r != MPI_SUCCESS) complain("fail to split mpi comm");
+  g.iosz = ts[me].iosz;
+  g.valsz = ts[me].valsz;
+  g.epochgap = ts[me].epochgap;
+  dirname = g.dirname;
+  snprintf(tmp, sizeof(tmp), ".t%d", me);
+  dir[0] = std::string(g.dirname) + tmp;
+  dir[1] = dir[0] + ".shared";
+  v[0] = uint64_t(g.nkeys) * g.valsz * g.nepochs * g.ndirs;
+
+  for (int i = 0; i < n; i++) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (i != me) continue;
+    MPI_Comm_rank(comm, &r);
+    if (!r) printf("\n==tenant %d alone:\n", me);
+    g.dirname = dir[0].c_str();
+    write();
+    v[1] = wtime; /* excludes reports, which the shared run skips */
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  g.dirname = dir[1].c_str();
+  quiet = 1;
+  write();
+  v[2] = wtime;
+  quiet = 0;
+  g.dirname = dirname;
+  MPI_Comm_free(&comm);
+  comm = MPI_COMM_WORLD;
+
+  if (!g.myrank) all.resize(3 * g.commsz);
+  r = MPI_Gather(v, 3, MPI_UINT64_T, all.data(), 3, MPI_UINT64_T, 0,
+                 MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi gather");
+  if (g.myrank) return;
+  printf("\n==tenant results:\n");
+  for (int i = 0, w = 0; i < n; w += ts[i].nranks, i++) {
+    uint64_t bytes = 0;
+    uint64_t t[2] = {0, 0};
+    for (int j = w; j < w + ts[i].nranks; j++) {
+      bytes += all[3 * j];
+      t[0] = std::max(t[0], all[3 * j + 1]);
+      t[1] = std::max(t[1], all[3 * j + 2]);
+    }
+    printf("\ttenant %d (%d ranks, iosz %d, valsz %d, gap %d ms): "
+           "%.1f MB/s alone, %.1f MB/s shared (%.1f%% slowdown)\n",
+           i, ts[i].nranks, ts[i].iosz, ts[i].valsz, ts[i].epochgap,
+           double(bytes) / (t[0] + 1), double(bytes) / (t[1] + 1),
+           t[0] ? (double(t[1]) / t[0] - 1) * 100 : 0.0);
+  }
+}
+
+/*
+ * scenario parameters. a parameter set by a phase stays in effect for all
+ * later phases.
+ */
+static const struct sp {
+  const char* name;
+  int* v;
+} sps[] = {
+    {"epochs", &g.nepochs},  {"keys", &g.nkeys},      {"keysz", &g.keysz},
+    {"valsz", &g.valsz},     {"iosz", &g.iosz},       {"gap", &g.epochgap},
+    {"queries", &g.nqueries}, {"depth", &g.qdepth},   {"batch", &g.nbatch},
+    {"hot", &g.hotkeys},     {"cold", &g.coldwarm},  {"bg", &g.bg},
+    {"skew", &g.skew},       {"absent", &g.absent},
+};
+
+/*
+ * scenario: run the phases listed in a scenario file, one per line:
+ *
+ *   write [param=value ...]  write a new plfsdir (plfsdir.0, plfsdir.1, ...)
+ *   read [param=value ...]   query the most recently written plfsdir
+ *   reopen                   reopen the most recent plfsdir for reading
+ *   idle ms=num              stay idle (or compute elsewhere) for num ms
+ *   set [param=value ...]    only change parameters
+ *
+ * where params are the names in sps[] and cache=bytes. blank lines and
+ * lines starting with # are skipped. each phase prints its own results.
+ */
+static void scenario() {
+  std::string dir;
+  const char* dirname;
+  char line[500];
+  char* saveptr;
+  char* op;
+  char* kv;
+  uint64_t t;
+  FILE* f;
+  int nwrites;
+  int lineno;
+  int ms;
+  int bg;
+  int n;
+
+  f = fopen(g.scenario, "r");
+  if (!f) complain("cannot open scenario %s: %s", g.scenario, strerror(errno));
+  dirname = g.dirname;
+  nwrites = lineno = n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineno++;
+    line[strcspn(line, "\n")] = 0;
+    if (!g.myrank && line[0] && line[0] != '#')
+      printf("\n==phase %d: %s\n", n, line);
+    op = strtok_r(line, " \t", &saveptr);
+    if (!op || op[0] == '#') continue;
+    ms = 0;
+    bg = g.bg;
+    while ((kv = strtok_r(NULL, " \t", &saveptr)) != NULL) {
+      char* val = strchr(kv, '=');
+      size_t i;
+      if (!val) complain("%s:%d: bad param %s", g.scenario, lineno, kv);
+      *val++ = 0;
+      if (strcmp(kv, "ms") == 0) {
+        ms = atoi(val);
+        continue;
+      } else if (strcmp(kv, "cache") == 0) {
+        g.cachesz = atoll(val);
+        continue;
+      }
+      for (i = 0; i < sizeof(sps) / sizeof(sps[0]); i++) {
+        if (strcmp(kv, sps[i].name) == 0) break;
+      }
+      if (i == sizeof(sps) / sizeof(sps[0]) || atoi(val) < 0)
+        complain("%s:%d: bad param %s", g.scenario, lineno, kv);
+      *sps[i].v = atoi(val);
+    }
+    if (g.bg != bg && bgp) { /* the next mkconf() makes a new pool */
+      rmpool(bgp);
+      bgp = NULL;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t = now();
+    if (strcmp(op, "write") == 0) {
+      char tmp[20];
+      snprintf(tmp, sizeof(tmp), ".%d", nwrites++);
+      dir = std::string(dirname) + tmp;
+      g.dirname = dir.c_str();
+      write();
+    } else if (strcmp(op, "read") == 0 || strcmp(op, "reopen") == 0) {
+      if (!nwrites) complain("%s:%d: nothing to read", g.scenario, lineno);
+      if (g.ndirs > 1 || g.aggbatch)
+        complain("%s:%d: cannot read this plfsdir", g.scenario, lineno);
+      if (strcmp(op, "read") == 0) {
+        if ((g.nqueries || g.nbatch) && !g.nkeys)
+          complain("%s:%d: nothing to query", g.scenario, lineno);
+        read();
+      } else {
+        openrd();
+        closerd();
+      }
+    } else if (strcmp(op, "idle") == 0) {
+      usleep(useconds_t(ms) * 1000);
+    } else if (strcmp(op, "set") != 0) {
+      complain("%s:%d: unknown phase %s", g.scenario, lineno, op);
+    }
+    t = now() - t;
+    MPI_Reduce(g.myrank ? &t : MPI_IN_PLACE, &t, 1, MPI_UINT64_T, MPI_MAX, 0,
+               MPI_COMM_WORLD);
+    if (!g.myrank) printf("\tphase %d time: %.3f s\n", n, double(t) / 1000000);
+    n++;
+  }
+  fclose(f);
+  g.dirname = dirname;
+}
+
+/*
+ * openbench: run repeated create_handle/open/finish cycles and measure
+ * the cost of each call on every rank. each cycle uses a new plfsdir
+ * under plfsdir.open/ so that all files must be created again.
+ */
+static void openbench() {
+  static const char* calls[3] = {"create_handle", "open", "finish"};
+  std::vector<uint64_t> lat[3];
+  deltafs_plfsdir_t* h;
+  std::string path;
+  struct dirent* ent;
+  char tmp[30];
+  uint64_t mdops; /* dirs and files created */
+  uint64_t sum;
+  uint64_t t;
+  DIR* d;
+  int r;
+
+  if (g.bbos) mkbbos();
+  mkconf(g.myrank);
+  mdops = 0;
+  for (int c = 0; c < g.ncycles; c++) {
+    snprintf(tmp, sizeof(tmp), ".open/c%d", c);
+    path = std::string(g.dirname) + tmp;
+    /* the cycle's dir is created up front in both modes so that both
+     * count the same ops, plus the per-rank subdirs under -p */
+    mdops += mkdirs(path);
+    if (g.precreate) {
+      snprintf(tmp, sizeof(tmp), "/r%08x", g.myrank);
+      path += tmp;
+      mdops += mkdirs(path);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (g.stagger) usleep(useconds_t(g.myrank) * g.stagger);
+
+    t = now();
+    h = deltafs_plfsdir_create_handle(cf.c_str(), O_WRONLY);
+    if (!h) complain("fail to create plfsdir handle");
+    lat[0].push_back(now() - t);
+    deltafs_plfsdir_set_err_printer(h, printerr, NULL);
+    if (bgp) deltafs_plfsdir_set_thread_pool(h, bgp);
+    if (env) deltafs_plfsdir_set_env(h, env);
+    t = now();
+    r = deltafs_plfsdir_open(h, path.c_str());
+    if (r) complain("error opening dir: %s", strerror(errno));
+    lat[1].push_back(now() - t);
+    t = now();
+    r = deltafs_plfsdir_finish(h);
+    if (r) complain("error finalizing dir: %s", strerror(errno));
+    lat[2].push_back(now() - t);
+    deltafs_plfsdir_free_handle(h);
+
+    snprintf(tmp, sizeof(tmp), "L-%08x", g.myrank);
+    d = opendir(path.c_str());
+    while (d && (ent = readdir(d)) != NULL) {
+      if (strncmp(ent->d_name, tmp, strlen(tmp)) == 0) mdops++;
+    }
+    if (d) closedir(d);
+  }
+
+  if (!g.myrank) printf("\n==open/finish results:\n");
+  for (int i = 0; i < 3; i++) {
+    sum = std::accumulate(lat[i].begin(), lat[i].end(), uint64_t(0));
+    report(calls[i], &lat[i], sum);
+  }
+  r = MPI_Reduce(g.myrank ? &mdops : MPI_IN_PLACE, &mdops, 1, MPI_UINT64_T,
+                 MPI_SUM, 0, MPI_COMM_WORLD);
+  if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+  if (!g.myrank)
+    printf("\tmetadata ops: %llu dirs and files created (%.1f per cycle)\n",
+           (unsigned long long)mdops, double(mdops) / g.ncycles);
+}
+
+/*
+ * fkey: encode an integer key id as a raw plfsdir key
+ */
+static void fkey(uint64_t id, std::string* k) {
+  k->assign(g.keysz, 0);
+  memcpy(&(*k)[0], &id, std::min(size_t(g.keysz), sizeof(id)));
+}
+
+/*
+ * fbench: compare plfsdir filters. for each filter in g.filters and each
+ * key stride in g.strides, every rank puts nkeys integer keys (0, stride,
+ * 2 * stride, ...) into its own partition of a new plfsdir, then reads the
+ * partition back with lookups of present and absent keys. reported are
+ * the epoch flush time (which includes filter construction), filter size
+ * per key, false-positive rate (absent keys that still cost table reads),
+ * and lookup latency.
+ */
+static void fbench() {
+  std::vector<uint64_t> lat;
+  std::vector<int> strides;
+  std::string spec;
+  std::string path;
+  std::string k;
+  std::string v;
+  deltafs_plfsdir_t* h;
+  kvlist saved;
+  char tmp[100];
+  uint64_t x[5]; /* keys, filter bytes, flush time, absent keys, false pos */
+  uint64_t sums[5];
+  size_t ts;
+  size_t sz;
+  char* data;
+  char* fmt;
+  char* p;
+  int nq;
+  int bits;
+  int r;
+
+  snprintf(tmp, sizeof(tmp), "%s", g.strides);
+  for (p = strtok(tmp, ","); p; p = strtok(NULL, ",")) {
+    if (atoi(p) <= 0) complain("bad key stride %s", p);
+    strides.push_back(atoi(p));
+  }
+  if (g.keysz < 4) complain("filter comparison needs keys of 4+ bytes");
+  nq = g.nqueries ? g.nqueries : DEF_FILTER_QUERIES;
+  v.resize(g.valsz, '.');
+  spec = g.filters;
+  if (!g.myrank) printf("\n==filter results:\n");
+  for (char* f = strtok_r(&spec[0], ",", &p); f; f = strtok_r(NULL, ",", &p)) {
+    fmt = strchr(f, ':');
+    if (fmt) *fmt++ = 0;
+    for (size_t i = 0; i < strides.size(); i++) {
+      /* absent keys go up to twice the largest present key */
+      uint64_t maxkey = uint64_t(g.nkeys) * strides[i] * 2;
+      for (bits = 1; bits < 64 && (uint64_t(1) << bits) < maxkey;) bits++;
+      saved = cfo;
+      snprintf(tmp, sizeof(tmp), "filter=%s", f);
+      if (cfset(tmp) != 0) complain("bad filter %s", f);
+      snprintf(tmp, sizeof(tmp), "bm_fmt=%s", fmt ? fmt : "");
+      if (fmt && cfset(tmp) != 0) complain("bad bitmap format %s", fmt);
+      cfint(&cfo, "bm_key_bits", bits);
+      mkconf(g.myrank);
+      cfo = saved;
+      snprintf(tmp, sizeof(tmp), ".filter.%s%s%s.s%d", f, fmt ? "-" : "",
+               fmt ? fmt : "", strides[i]);
+      path = std::string(g.dirname) + tmp;
+
+      h = deltafs_plfsdir_create_handle(cf.c_str(), O_WRONLY);
+      if (!h) complain("fail to create plfsdir handle");
+      deltafs_plfsdir_set_err_printer(h, printerr, NULL);
+      if (bgp) deltafs_plfsdir_set_thread_pool(h, bgp);
+      if (env) deltafs_plfsdir_set_env(h, env);
+      r = deltafs_plfsdir_open(h, path.c_str());
+      if (r) complain("error opening dir: %s", strerror(errno));
+      for (int j = 0; j < g.nkeys; j++) {
+        fkey(uint64_t(j) * strides[i], &k);
+        r = deltafs_plfsdir_put(h, k.data(), k.size(), 0, v.data(), v.size());
+        if (r) complain("error writing key %d: %s", j, strerror(errno));
+      }
+      x[2] = now();
+      r = deltafs_plfsdir_epoch_flush(h, 0);
+      if (r) complain("error flushing dir: %s", strerror(errno));
+      x[2] = now() - x[2];
+      r = deltafs_plfsdir_finish(h);
+      if (r) complain("error finalizing dir: %s", strerror(errno));
+      x[1] = uint64_t(std::max(
+          deltafs_plfsdir_get_integer_property(h, "sstable_filter_bytes"),
+          0LL));
+      deltafs_plfsdir_free_handle(h);
+
+      h = deltafs_plfsdir_create_handle(cf.c_str(), O_RDONLY);
+      if (!h) complain("fail to create plfsdir handle");
+      if (bgp) deltafs_plfsdir_set_thread_pool(h, bgp);
+      if (env) deltafs_plfsdir_set_env(h, env);
+      r = deltafs_plfsdir_open(h, path.c_str());
+      if (r) complain("error opening dir: %s", strerror(errno));
+      x[0] = uint64_t(g.nkeys);
+      x[3] = x[4] = 0;
+      lat.clear();
+      srandom(g.myrank + 1);
+      for (int j = 0; g.nkeys && j < nq; j++) {
+        uint64_t id = uint64_t(random() % g.nkeys) * strides[i];
+        uint64_t t;
+        fkey(id, &k);
+        t = now();
+        data = deltafs_plfsdir_get(h, k.data(), k.size(), 0, &sz, NULL, NULL);
+        if (!data) complain("error reading key: %s", strerror(errno));
+        lat.push_back(now() - t);
+        free(data);
+        /* absent: between present keys when sparse, else above them */
+        id += strides[i] > 1 ? 1 : uint64_t(g.nkeys) * strides[i];
+        fkey(id, &k);
+        ts = 0;
+        data = deltafs_plfsdir_get(h, k.data(), k.size(), 0, &sz, &ts, NULL);
+        if (!data) complain("error reading key: %s", strerror(errno));
+        free(data);
+        x[3]++;
+        if (ts) x[4]++;
+      }
+      deltafs_plfsdir_free_handle(h);
+
+      r = MPI_Reduce(x, sums, 5, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+      r = MPI_Reduce(&x[2], &sums[2], 1, MPI_UINT64_T, MPI_MAX, 0,
+                     MPI_COMM_WORLD);
+      if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+      if (!g.myrank) {
+        printf("\t%s%s%s, stride %d: flush %.3f s, filter %.2f bits/key, "
+               "false positives %.3f%%\n",
+               f, fmt ? ":" : "", fmt ? fmt : "", strides[i],
+               double(sums[2]) / 1000000,
+               sums[0] ? double(sums[1]) * 8 / sums[0] : 0.0,
+               sums[3] ? double(sums[4]) * 100 / sums[3] : 0.0);
+      }
+      snprintf(tmp, sizeof(tmp), "%s%s%s stride %d get", f, fmt ? ":" : "",
+               fmt ? fmt : "", strides[i]);
+      report(tmp, &lat, std::accumulate(lat.begin(), lat.end(), uint64_t(0)));
+    }
+  }
+}
+
+/*
+ * csaver: scan callback counting the bytes scanned
+ */
+static int csaver(void* arg, const char* key, size_t keylen, const char* value,
+                  size_t sz) {
+  *static_cast<uint64_t*>(arg) += keylen + sz;
+  return 0;
+}
+
+/*
+ * cpusecs: get the cpu time (usr + sys, in secs) used by the calling
+ * process so far
+ */
+static double cpusecs() {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+         double(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000;
+}
+
+/*
+ * cbench: compare checksum costs. the plfsdir is written once with
+ * checksums and once with skip_checksums (at plfsdir.cksum.on and
+ * plfsdir.cksum.off), and each copy is then scanned and queried with and
+ * without verify_checksums. each rank reads its own partition. reported
+ * are ingest cpu per MB, scan bandwidth and cpu per MB, lookup latency,
+ * and the cpu per MB that checksums add on each path.
+ */
+static void cbench() {
+  static const char* onoff[2] = {"on", "off"};
+  std::vector<uint64_t> lat;
+  std::string path;
+  deltafs_plfsdir_t* h;
+  const char* dirname;
+  kvlist saved;
+  double cpu[2][3]; /* write, scan w/o and w/ verify (cpu ms per MB) */
+  double x[2];
+  double sum[2];
+  char tmp[100];
+  uint64_t bytes;
+  uint64_t scanned;
+  uint64_t t;
+  size_t sz;
+  char* data;
+  int r;
+
+  dirname = g.dirname;
+  saved = cfo;
+  srandom(g.myrank + 1);
+  for (int skip = 0; skip < 2; skip++) {
+    cfput(&cfo, "skip_checksums", skip ? "1" : "0");
+    path = std::string(dirname) + ".cksum." + onoff[skip];
+    g.dirname = path.c_str();
+    bytes = uint64_t(g.nkeys) * g.valsz * g.nepochs;
+    x[0] = cpusecs();
+    t = now();
+    quiet = 1;
+    write();
+    quiet = 0;
+    x[0] = cpusecs() - x[0];
+    x[1] = double(now() - t) / 1000000;
+    r = MPI_Reduce(x, sum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+    cpu[skip][0] = sum[0] * 1000 * 1048576 / (double(bytes) * g.commsz);
+    if (!g.myrank) {
+      if (!skip) printf("\n==checksum results:\n");
+      printf("\twrite, checksums %s: %.3f cpu ms/MB, %.1f MB/s\n",
+             onoff[skip], cpu[skip][0],
+             double(bytes) * g.commsz * g.commsz / sum[1] / 1048576);
+    }
+
+    for (int verify = 0; verify < 2; verify++) {
+      cfput(&cfo, "verify_checksums", verify ? "1" : "0");
+      h = tryopen(g.myrank);
+      if (!h) complain("cannot open %s: %s", g.dirname, strerror(errno));
+      scanned = 0;
+      x[0] = cpusecs();
+      t = now();
+      for (int e = 0; e < g.nepochs; e++) {
+        if (deltafs_plfsdir_scan(h, e, csaver, &scanned) < 0)
+          complain("error scanning epoch %d: %s", e, strerror(errno));
+      }
+      x[0] = cpusecs() - x[0];
+      x[1] = double(now() - t) / 1000000;
+      lat.clear();
+      for (int i = 0; i < g.nqueries; i++) {
+        snprintf(tmp, sizeof(tmp), "f%08x-r%08x", rkey(), g.myrank);
+        t = now();
+        data = deltafs_plfsdir_read(h, tmp, int(random() % g.nepochs), &sz,
+                                    NULL, NULL);
+        if (!data) complain("error reading %s: %s", tmp, strerror(errno));
+        lat.push_back(now() - t);
+        free(data);
+      }
+      deltafs_plfsdir_free_handle(h);
+
+      r = MPI_Reduce(x, sum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+      r = MPI_Reduce(g.myrank ? &scanned : MPI_IN_PLACE, &scanned, 1,
+                     MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (r != MPI_SUCCESS) complain("fail to do mpi reduce");
+      cpu[skip][1 + verify] = scanned ? sum[0] * 1000 * 1048576 / scanned : 0;
+      if (!g.myrank)
+        printf("\tscan, checksums %s, verify %s: %.1f MB/s, %.3f cpu ms/MB\n",
+               onoff[skip], onoff[!verify],
+               double(scanned) * g.commsz / (sum[1] + 1e-9) / 1048576,
+               cpu[skip][1 + verify]);
+      snprintf(tmp, sizeof(tmp), "lookup, checksums %s, verify %s",
+               onoff[skip], onoff[!verify]);
+      report(tmp, &lat, std::accumulate(lat.begin(), lat.end(), uint64_t(0)));
+    }
+    cfo = saved;
+  }
+  g.dirname = dirname;
+
+  if (!g.myrank) {
+    printf("\tchecksum cost: %.3f cpu ms/MB on writes, %.3f cpu ms/MB on "
+           "verified reads\n",
+           cpu[0][0] - cpu[1][0], cpu[0][2] - cpu[0][1]);
+  }
+}
+
+/*
+ * main program
+ */
+int main(int argc, char* argv[]) {
+  int r, ch;
+  r = MPI_Init(&argc, &argv);
+  if (r != MPI_SUCCESS) complain("fail to init mpi");
+  argv0 = argv[0];
+  memset(b.remote, 0, sizeof(b.remote));
+  memset(b.lo, 0, sizeof(b.lo));
+  /* we want lines, even if we are writing to a pipe */
+  setlinebuf(stdout);
+
+  memset(&g, 0, sizeof(g));
+  r = MPI_Comm_rank(MPI_COMM_WORLD, &g.myrank);
+  if (r != MPI_SUCCESS) complain("cannot get proc mpi rank");
+  r = MPI_Comm_size(MPI_COMM_WORLD, &g.commsz);
+  if (r != MPI_SUCCESS) complain("cannot get mpi world size");
+
+  g.nepochs = DEF_NUM_EPOCHS;
+  g.nkeys = DEF_NUM_KEYS_PER_EPOCH;
+  g.filterbits = DEF_FILTER_BITS;
+  g.keysz = DEF_KEY_SIZE;
+  g.valsz = DEF_VAL_SIZE;
+  g.bbosproto = DEF_BBOS_PROTO;
+  g.bboshostname = DEF_BBOS_HOSTNAME;
+  g.bbosport = DEF_BBOS_PORT;
+  g.timeout = DEF_TIMEOUT;
+  g.iosz = DEF_IO_SIZE;
+  g.ndirs = 1;
+  g.strides = DEF_FILTER_STRIDES;
+  g.pthreads = 1;
+
+  while ((ch = getopt(argc, argv,
+                      "s:e:n:f:k:d:j:t:q:w:Q:B:i:C:H:I:l:R:O:S:D:"
+                      "m:T:L:N:A:G:E:M:F:K:c:U:W:V:Y:z:JPpuyZoxXarvb")) != -1) {
+    switch (ch) {
+      case 's':
+        g.iosz = atoi(optarg);
+        if (g.iosz <= 0) usage("bad io size");
+        break;
+      case 'e':
+        g.nepochs = atoi(optarg);
+        if (g.nepochs < 0) usage("bad epoch nums");
+        break;
+      case 'n':
+        g.nkeys = atoi(optarg);
+        if (g.nkeys < 0) usage("bad key nums");
+        break;
+      case 'f':
+        g.filterbits = atoi(optarg);
+        if (g.filterbits < 0) usage("bad filter bits");
+        break;
+      case 'k':
+        g.keysz = atoi(optarg);
+        if (g.keysz <= 0) usage("bad key size");
+        break;
+      case 'd':
+        g.valsz = atoi(optarg);
+        if (g.valsz < 0) usage("bad value size");
+        break;
+      case 'j':
+        g.bg = atoi(optarg);
+        if (g.bg < 0) usage("bad bg number");
+        break;
+      case 't':
+        g.timeout = atoi(optarg);
+        if (g.timeout < 0) usage("bad timeout");
+        break;
+      case 'q':
+        g.nqueries = atoi(optarg);
+        if (g.nqueries < 0) usage("bad query nums");
+        break;
+      case 'w':
+        g.nwriters = atoi(optarg);
+        if (g.nwriters <= 0) usage("bad writer nums");
+        break;
+      case 'Q':
+        g.qdepth = atoi(optarg);
+        if (g.qdepth < 0) usage("bad query depth");
+        break;
+      case 'B':
+        g.nbatch = atoi(optarg);
+        if (g.nbatch < 0) usage("bad batch size");
+        break;
+      case 'i':
+        g.keyfile = optarg;
+        break;
+      case 'C':
+        g.cachesz = atoll(optarg);
+        if (g.cachesz < 0) usage("bad cache size");
+        break;
+      case 'H':
+        g.hotkeys = atoi(optarg);
+        if (g.hotkeys < 0) usage("bad hot key nums");
+        break;
+      case 'I':
+        g.skew = atoi(optarg);
+        if (g.skew < 0) usage("bad key skew");
+        break;
+      case 'l':
+        g.absent = atoi(optarg);
+        if (g.absent < 0 || g.absent > 100) usage("bad absent key percent");
+        break;
+      case 'P':
+        g.preload = 1;
+        break;
+      case 'R':
+        g.nrww = atoi(optarg);
+        if (g.nrww < 0) usage("bad reader nums");
+        break;
+      case 'O':
+        g.ncycles = atoi(optarg);
+        if (g.ncycles < 0) usage("bad cycle nums");
+        break;
+      case 'S':
+        g.stagger = atoi(optarg);
+        if (g.stagger < 0) usage("bad stagger");
+        break;
+      case 'D':
+        g.ndirs = atoi(optarg);
+        if (g.ndirs <= 0) usage("bad plfsdir nums");
+        break;
+      case 'J':
+        g.dedicated = 1;
+        break;
+      case 'm':
+        g.vmmon = atoi(optarg);
+        if (g.vmmon < 0) usage("bad sampling interval");
+        break;
+      case 'y':
+        g.sync = 1;
+        break;
+      case 'T':
+        g.drain = optarg;
+        break;
+      case 'L':
+        g.drainbw = atoi(optarg);
+        if (g.drainbw < 0) usage("bad drain bandwidth");
+        break;
+      case 'Z':
+        g.zerocopy = 1;
+        break;
+      case 'E':
+        g.epochgap = atoi(optarg);
+        if (g.epochgap < 0) usage("bad epoch gap");
+        break;
+      case 'M':
+        g.tenants = optarg;
+        break;
+      case 'F':
+        g.scenario = optarg;
+        break;
+      case 'K':
+        if (cfset(optarg) != 0) usage("bad plfsdir conf");
+        break;
+      case 'c':
+        cfload(optarg);
+        break;
+      case 'U':
+        g.filters = optarg;
+        break;
+      case 'W':
+        g.strides = optarg;
+        break;
+      case 'X':
+        g.cksum = 1;
+        break;
+      case 'a':
+        g.amp = 1;
+        break;
+      case 'Y':
+        g.pscan = 1;
+        g.pthres = float(atof(optarg));
+        break;
+      case 'z':
+        g.pthreads = atoi(optarg);
+        if (g.pthreads <= 0) usage("bad scan thread nums");
+        break;
+      case 'V':
+        g.window = optarg;
+        if (strstr(optarg, "..")) {
+          if (sscanf(optarg, "%d..%d", &g.wfirst, &g.wend) != 2 ||
+              g.wfirst < 0 || g.wend < g.wfirst)
+            usage("bad query window");
+        } else {
+          g.wlast = atoi(optarg);
+          if (g.wlast <= 0) usage("bad query window");
+        }
+        break;
+      case 'G':
+        g.slowsd = atof(optarg);
+        if (g.slowsd <= 0) usage("bad std devs");
+        break;
+      case 'A':
+        g.aggbatch = atoi(optarg);
+        if (g.aggbatch < 0) usage("bad aggregation batch");
+        break;
+      case 'N':
+        g.nodebw = atoi(optarg);
+        if (g.nodebw < 0) usage("bad node bandwidth");
+        break;
+      case 'u':
+        g.tpmon = 1;
+        break;
+      case 'p':
+        g.precreate = 1;
+        break;
+      case 'o':
+        g.coldwarm = 1;
+        break;
+      case 'x':
+        g.skipwrite = 1;
+        break;
+      case 'r':
+        g.logrotation = 1;
+        break;
+      case 'b':
+        g.bbos = 1;
+        break;
+      case 'v':
+        g.v = 1;
+        break;
+      default:
+        usage(NULL);
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  if (argc == 0) /* plfsdir must be provided on command line */
+    usage("bad args");
+  g.dirname = argv[0];
+  if (argc > 1) g.bboshostname = argv[1];
+  if (argc > 2) g.bbosport = atoi(argv[2]);
+  if (g.bbosport <= 0) usage("bad bbos port");
+  if (!g.nwriters) g.nwriters = g.commsz;
+  if (!g.skipwrite && g.nwriters != g.commsz)
+    usage("num writers must match comm size when writing");
+  if ((g.nqueries || g.nbatch) && !g.nkeys) usage("nothing to query");
+  if (g.nrww && (g.nrww >= g.commsz || g.skipwrite || !g.nkeys))
+    usage("read while write needs writer ranks and keys");
+  if (!dcfo.empty() && dcfo.rbegin()->first >= g.ndirs)
+    usage("conf set for a plfsdir beyond -D");
+  if (g.ndirs > 1 &&
+      (g.nrww || g.nqueries || g.nbatch || g.keyfile || g.pscan))
+    usage("reads only work with a single plfsdir");
+  if (g.aggbatch &&
+      (g.nrww || g.nqueries || g.nbatch || g.keyfile || g.pscan))
+    usage("reads do not work with aggregated writes");
+  if (g.tenants && (g.nrww || g.nqueries || g.nbatch || g.keyfile || g.pscan ||
+                    g.skipwrite || g.aggbatch))
+    usage("tenant groups only write");
+  if (g.scenario && (g.tenants || g.nrww || g.skipwrite || g.keyfile))
+    usage("scenarios cannot be combined with other modes");
+  if (g.cksum && (g.ndirs > 1 || g.aggbatch || !g.nkeys))
+    usage("checksum comparison needs keys and a plfsdir per rank");
+  printopts();
+
+  signal(SIGALRM, sigalarm);
+  alarm(g.timeout);
+
+  dirs = NULL;
+  rd = NULL;
+  env = NULL;
+  bgp = NULL;
+
+  if (g.v && !g.myrank) info("test begins ...");
+  comm = MPI_COMM_WORLD;
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (g.ncycles) openbench();
+  if (g.filters) fbench();
+  if (g.cksum) cbench();
+  if (g.scenario) {
+    scenario();
+  } else if (g.tenants) {
+    tenants();
+  } else if (g.nrww) {
+    rww();
+  } else {
+    if (!g.skipwrite) write();
+    if (g.nqueries || g.nbatch || g.keyfile || g.pscan) read();
+  }
 
   MPI_Finalize();
 